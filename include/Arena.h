@@ -0,0 +1,53 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+// Bump allocator for scratch that lives for one tick. Allocating moves an
+// offset along a block and nothing is freed until Reset(), which rewinds
+// it. A tick that outgrows the block takes more blocks from the heap; the
+// next Reset() swaps them all for one block holding as much, so once an
+// arena has seen its busiest tick it never allocates again.
+//
+// An arena serves one thread at a time; give each thread its own.
+class Arena {
+public:
+  void *Allocate(size_t size, size_t alignment);
+  template <typename T> T *Allocate(size_t count) {
+    return (T *)Allocate(count * sizeof(T), alignof(T));
+  }
+  // Everything allocated so far becomes invalid
+  void Reset();
+  // Bytes held, used or not
+  size_t Capacity() const;
+
+private:
+  std::vector<std::vector<char>> blocks; // Allocating from the last
+  size_t used = 0;                       // Of the last block
+};
+
+// Lets standard containers take their storage from an arena. Freeing does
+// nothing; the storage comes back when the arena is reset, so a container
+// using it must not outlive the tick.
+template <typename T> struct ArenaAllocator {
+  typedef T value_type;
+
+  Arena *arena;
+
+  explicit ArenaAllocator(Arena *arena) : arena(arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+  T *allocate(size_t count) { return arena->Allocate<T>(count); }
+  void deallocate(T *, size_t) {}
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+  return a.arena == b.arena;
+}
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+  return a.arena != b.arena;
+}
+
+template <typename T> using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+// Fixed-size bit array packed into 64-bit words, so whole-network passes can
+// test or combine 64 segments at a time
+struct BitSet {
+  std::vector<uint64_t> words;
+  int size = 0;
+
+  void Resize(int bitCount) {
+    size = bitCount;
+    words.assign((bitCount + 63) / 64, 0);
+  }
+  int WordCount() const { return (int)words.size(); }
+
+  bool Test(int i) const { return (words[i >> 6] >> (i & 63)) & 1; }
+  void Set(int i) { words[i >> 6] |= (uint64_t)1 << (i & 63); }
+  void Reset(int i) { words[i >> 6] &= ~((uint64_t)1 << (i & 63)); }
+  void Assign(int i, bool value) { value ? Set(i) : Reset(i); }
+
+  void ClearAll() { words.assign(words.size(), 0); }
+  void SetAll() {
+    words.assign(words.size(), ~(uint64_t)0);
+    if (size & 63) {
+      words.back() = ((uint64_t)1 << (size & 63)) - 1;
+    }
+  }
+};
+
+// Index of the lowest set bit; word must be non-zero
+inline int LowestBit(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(word);
+#else
+  int bit = 0;
+  while (!(word & 1)) {
+    word >>= 1;
+    bit++;
+  }
+  return bit;
+#endif
+}
@@ -4,4 +4,5 @@
 constexpr ImU32 GREEN = IM_COL32(0, 255, 0, 255);
 constexpr ImU32 RED = IM_COL32(255, 0, 0, 255);
 constexpr ImU32 ORANGE = IM_COL32(255, 165, 0, 255);
+constexpr ImU32 YELLOW = IM_COL32(255, 255, 0, 255);
 constexpr ImU32 WHITE = IM_COL32(255, 255, 255, 255);
@@ -0,0 +1,31 @@
+#pragma once
+#include "imgui.h"
+#include "imgui_internal.h"
+#include <memory>
+#include <vector>
+
+// Draw lists that worker threads fill in parallel, merged into the frame's
+// draw data once ImGui::Render() has built it. Each list has a private copy
+// of the context's shared draw data, since path drawing writes to its
+// scratch buffer; the font atlas the copies point at is only read.
+//
+// Call Begin() on the main thread after ImGui::NewFrame(), fill each batch
+// from at most one thread, then MergeInto() on the main thread.
+class DrawBatches {
+public:
+  void Begin(int batchCount);
+  int BatchCount() const { return activeCount; }
+  ImDrawList *Batch(int index) { return &batches[index]->list; }
+  // Appends the batches after ImGui's own lists, so they draw on top
+  void MergeInto(ImDrawData *drawData);
+
+private:
+  struct DrawBatch {
+    ImDrawListSharedData data;
+    ImDrawList list;
+    DrawBatch() : list(&data) {}
+  };
+
+  std::vector<std::unique_ptr<DrawBatch>> batches;
+  int activeCount = 0;
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+
+enum SimEventType_ {
+  SimEvent_CertificateFailure,
+};
+
+// A simulation event. Handlers compare generation with the subject's
+// current generation, so superseded events can be left in the queue.
+struct SimEvent {
+  double time;
+  int type;
+  int subject;
+  unsigned generation;
+};
+
+// Time-ordered queue of pending simulation events
+struct EventQueue {
+  void Push(const SimEvent &event) {
+    heap.push_back(event);
+    std::push_heap(heap.begin(), heap.end(), Later);
+  }
+
+  // Pops the earliest event if it is due by `now`
+  bool PopDue(double now, SimEvent *event) {
+    if (heap.empty() || heap.front().time > now) {
+      return false;
+    }
+    std::pop_heap(heap.begin(), heap.end(), Later);
+    *event = heap.back();
+    heap.pop_back();
+    return true;
+  }
+
+  bool Empty() const { return heap.empty(); }
+  int Size() const { return (int)heap.size(); }
+  void Clear() { heap.clear(); }
+
+private:
+  static bool Later(const SimEvent &a, const SimEvent &b) {
+    return a.time > b.time;
+  }
+
+  std::vector<SimEvent> heap;
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include "Occupancy.h"
+#include "TrackNetwork.h"
+#include <vector>
+
+// The stretch of one segment a train covers, as offsets along the segment
+struct TrainInterval {
+  int train;
+  float rear;
+  float front;
+  unsigned tick; // Last tick the interval was reported
+};
+
+// Two trains closer than the minimum headway; a negative gap is a collision
+struct HeadwayConflict {
+  int segment;
+  int rearTrain;
+  int frontTrain;
+  float gap;
+};
+
+// Sweep-and-prune headway and collision detection. Each segment keeps its
+// intervals sorted by rear offset across ticks, so re-sorting after trains
+// move is an insertion sort over nearly sorted data, and a sweep comparing
+// each interval with the furthest front seen so far finds every overlap.
+struct HeadwayMonitor {
+  float minimumHeadway = 2.0f;
+
+  void Resize(int segmentCount);
+
+  void Update(int segment, int train, float rear, float front);
+  // Reports every segment the train holds in occupancy, given where its
+  // tail and head are along their segments. The intervals are reported as
+  // train `id`, so trains of several simulations can share a monitor.
+  void UpdateTrain(const TrackNetwork &network, const Occupancy &occupancy,
+                   int train, int id, float tailOffset, float headOffset);
+
+  // Drops intervals not reported since the last call, then sweeps every
+  // segment and the link from each segment onto the next
+  void Detect(const TrackNetwork &network,
+              std::vector<HeadwayConflict> *conflicts);
+
+  // Sorted by rear offset as of the last Detect()
+  const std::vector<TrainInterval> &Intervals(int segment) const {
+    return segmentIntervals[segment];
+  }
+  const std::vector<int> &ActiveSegments() const { return activeSegments; }
+  // Bumped by Detect() whenever a segment's train order changed
+  unsigned OrderChanges() const { return orderChanges; }
+
+private:
+  std::vector<std::vector<TrainInterval>> segmentIntervals;
+  std::vector<int> activeSegments;
+  std::vector<unsigned char> isActive;
+  unsigned tick = 1;
+  unsigned orderChanges = 0;
+};
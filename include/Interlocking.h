@@ -0,0 +1,61 @@
+#pragma once
+#include "BitSet.h"
+#include "TrackNetwork.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// A route locks its segments and holds its switches in the given positions
+struct Route {
+  std::vector<int> segments;
+  std::vector<int> switches;
+  std::vector<unsigned char> switchReversed;
+};
+
+// Grants and releases routes against a conflict matrix precomputed when the
+// routes are built. Two routes conflict when they share a segment or a
+// switch. Set routes live in an atomic bitset, so requests from any number
+// of threads are decided without a lock, at one atomic load per non-zero
+// word of the requested route's conflict row.
+//
+// Operator switch throws take a hidden per-switch route that conflicts with
+// every route over that switch, so a switch cannot move under a set route.
+struct Interlocking {
+  Interlocking() : changeCount(0) {}
+
+  void Build(const TrackNetwork &network, const std::vector<Route> &routes);
+  int RouteCount() const { return routeCount; }
+  bool Conflicts(int a, int b) const { return conflicts[a].Test(b); }
+
+  // Sets the route and throws its switches, or returns false if a
+  // conflicting route is set. Concurrent conflicting requests may both be
+  // rejected, but never both granted. Switch positions shared with a copy
+  // of the network are copied on the first throw, so copy the network only
+  // while no requests are in flight.
+  bool RequestRoute(TrackNetwork *network, int route);
+  void ReleaseRoute(int route);
+  bool IsRouteSet(int route) const;
+
+  bool ThrowSwitch(TrackNetwork *network, int switchIndex, bool reversed);
+
+  // Union of the segments of every set route
+  void ReservedSegments(BitSet *reserved) const;
+  // Bumped on every grant and release
+  unsigned ChangeCount() const { return changeCount.load(); }
+
+  unsigned version = 0;
+
+private:
+  bool Claim(int route);
+
+  std::vector<Route> routes; // Built routes, then one throw route per switch
+  int routeCount = 0;
+  std::vector<BitSet> routeSegments;
+  std::vector<BitSet> conflicts;
+  // Non-zero words of each conflict row, as indices into the row
+  std::vector<int> conflictWordBegin;
+  std::vector<int> conflictWords;
+  std::unique_ptr<std::atomic<uint64_t>[]> setRoutes;
+  int setRouteWordCount = 0;
+  std::atomic<unsigned> changeCount;
+};
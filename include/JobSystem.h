@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing job system. Each worker owns a deque: it pushes and pops
+// jobs at the back, and idle workers steal from the front of the others.
+// ParallelFor splits its range in halves as it runs, so deques stay shallow
+// and large ranges spread across workers through stealing.
+//
+// ParallelFor may be called from one outside thread at a time; that thread
+// takes part in the work until the range is done.
+class JobSystem {
+public:
+  // With no workers every job runs on the calling thread
+  explicit JobSystem(int workerCount);
+  ~JobSystem();
+
+  int WorkerCount() const { return (int)threads.size(); }
+  // Workers plus the calling thread
+  int ThreadCount() const { return queueCount; }
+  // The calling thread's index below ThreadCount(): its worker's, or 0 for
+  // a thread outside the system
+  int ThreadIndex() const { return CallerQueue(); }
+
+  // Runs body(chunkBegin, chunkEnd) over [begin, end) in chunks of at most
+  // grain indices, returning once every chunk has finished
+  template <typename F>
+  void ParallelFor(int begin, int end, int grain, const F &body) {
+    if (begin >= end) {
+      return;
+    }
+    std::atomic<int> pending(1);
+    Job job;
+    job.run = &Invoke<F>;
+    job.body = &body;
+    job.begin = begin;
+    job.end = end;
+    job.grain = grain > 0 ? grain : 1;
+    job.pending = &pending;
+    Execute(CallerQueue(), job);
+    Wait(pending);
+  }
+
+private:
+  struct Job {
+    void (*run)(const void *body, int begin, int end);
+    const void *body;
+    int begin;
+    int end;
+    int grain;
+    std::atomic<int> *pending;
+  };
+
+  // Fixed-size ring; the splitting keeps a queue only log2 deep
+  struct WorkQueue {
+    static const int capacity = 256;
+    std::mutex mutex;
+    Job jobs[capacity];
+    int front = 0;
+    int count = 0;
+  };
+
+  template <typename F>
+  static void Invoke(const void *body, int begin, int end) {
+    (*(const F *)body)(begin, end);
+  }
+
+  int CallerQueue() const;
+  void Execute(int self, Job job);
+  bool Push(int self, const Job &job);
+  bool PopBack(int self, Job *job);
+  bool StealFront(int victim, Job *job);
+  bool RunOne(int self);
+  void Wait(std::atomic<int> &pending);
+  void WorkerLoop(int self);
+
+  std::unique_ptr<WorkQueue[]> queues;
+  int queueCount;
+  std::vector<std::thread> threads;
+  std::atomic<int> queuedJobs;
+  std::atomic<bool> stopping;
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+};
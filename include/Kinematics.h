@@ -0,0 +1,25 @@
+#pragma once
+#include "TrackNetwork.h"
+#include "TrainFleet.h"
+#include <vector>
+
+// Advances every train's offset by the distance covered over the last tick
+// at its current speed and acceleration, projects the head onto its
+// segment's direction to update x and y, and lists the trains whose head
+// passed the end of their segment for CrossSegments.
+//
+// Uses AVX2, eight trains at a time, when the CPU supports it and a scalar
+// loop otherwise.
+void UpdateKinematics(TrainFleet *fleet, const TrackNetwork &network, float dt,
+                      std::vector<int> *crossed);
+// The same for trains [begin, end), for splitting the fleet across threads.
+// crossed needs room for end - begin trains; returns how many it lists.
+int UpdateKinematics(TrainFleet *fleet, const TrackNetwork &network, float dt,
+                     int begin, int end, int *crossed);
+
+// The scalar loop on its own, regardless of CPU support
+void UpdateKinematicsScalar(TrainFleet *fleet, const TrackNetwork &network,
+                            float dt, std::vector<int> *crossed);
+
+// Name of the implementation UpdateKinematics dispatches to
+const char *KinematicsImplementation();
@@ -0,0 +1,77 @@
+#pragma once
+#include "EventQueue.h"
+#include "Headway.h"
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// A predicted loss of headway between two trains running one behind the
+// other, standing until the certificate it came from is re-solved or given
+// up
+struct ConflictWarning {
+  int rearTrain;
+  int frontTrain;
+  double conflictTime;
+  int certificate;
+  unsigned generation;
+};
+
+// Kinetic lookahead over the train order kept by HeadwayMonitor. Every pair
+// of adjacent trains, on one segment or either side of a segment end, holds
+// a certificate "no conflict within the lookahead", which is only re-solved
+// when the pair is new or one of its trains changes speed or acceleration.
+// The time the certificate fails is scheduled as an event, so between
+// changes a pair costs nothing per tick.
+struct KineticHeadway {
+  double lookahead = 30.0;
+  float minimumHeadway = 2.0f;
+
+  // Motion profile along the track, held until the next call. Only a change
+  // marks the train's pairs for re-solving.
+  void SetMotion(int train, float speed, float acceleration);
+
+  // Re-solves certificates whose pair or motion changed since the last call.
+  // now is in simulated seconds, the time speeds are measured in.
+  void Refresh(const TrackNetwork &network, const HeadwayMonitor &monitor,
+               double now, EventQueue *queue);
+
+  // Turns a due certificate failure into a warning unless it was superseded
+  void HandleEvent(const SimEvent &event,
+                   std::vector<ConflictWarning> *warnings) const;
+  // False once the pair's motion changed or they stopped running one
+  // behind the other, so the prediction no longer holds
+  bool IsCurrent(const ConflictWarning &warning) const {
+    return certificates[warning.certificate].generation ==
+           warning.generation;
+  }
+
+private:
+  struct Certificate {
+    int rearTrain;
+    int frontTrain;
+    double conflictTime;
+    unsigned generation;
+    unsigned refresh; // Last refresh the pair was adjacent in
+  };
+
+  // Keeps the pair's certificate for this refresh, solving it if new or
+  // either train's motion changed
+  void Certify(int rearTrain, int frontTrain, float gap, double now,
+               EventQueue *queue);
+  void Solve(Certificate *certificate, float gap, double now,
+             EventQueue *queue);
+  bool IsChanged(int train) const {
+    return train < (int)trainChanged.size() && trainChanged[train];
+  }
+
+  std::vector<float> trainSpeed;
+  std::vector<float> trainAcceleration;
+  std::vector<unsigned char> trainChanged;
+  bool anyChanged = false;
+
+  std::unordered_map<uint64_t, int> pairCertificate;
+  std::vector<Certificate> certificates;
+  std::vector<int> freeCertificates;
+  unsigned refreshCount = 0;
+  unsigned lastOrderChanges = ~0u;
+};
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdint.h>
+
+// Counts of latencies in microseconds, for percentiles of frame and tick
+// times. Buckets are log-linear as in HdrHistogram: one per microsecond
+// below 128, then 64 to each power of two, so a percentile is within 1/64
+// of the true value however far out the tail is. Recording is a few
+// instructions and never allocates.
+class LatencyHistogram {
+public:
+  static const int bucketCount = 25 * 64 + 128; // Up to 2^32 - 1 us
+
+  void Record(uint32_t microseconds);
+  void Clear();
+
+  // The latency the given fraction of samples are at or below, such as
+  // 0.999 for p99.9; 0 when nothing has been recorded
+  uint32_t Percentile(double fraction) const;
+  uint64_t Count() const { return count; }
+  uint32_t Max() const { return max; }
+
+private:
+  uint32_t counts[bucketCount] = {};
+  uint64_t count = 0;
+  uint32_t max = 0;
+};
@@ -0,0 +1,58 @@
+#pragma once
+#include "TrackNetwork.h"
+#include <stdint.h>
+
+// Binary track layouts that load by mapping the file and reading the track
+// graph's arrays in place, with no parsing or copying. Every array of
+// TrackNetwork is stored whole, in native byte order, starting on a
+// layoutFileAlignment boundary so it can be read directly as T[]. A loaded
+// network copies an array only when it is written, such as the switch
+// positions on the first throw.
+//
+// The header is followed by one LayoutFileArray per LayoutArray_ entry.
+// Files are rejected when the magic, version, byte order or any array's
+// extent does not match; the indices within the arrays are trusted, as
+// the layout tools are the only writers.
+static const char layoutFileMagic[8] = {'R', 'A', 'I', 'L', 'L', 'Y', 'T', 0};
+static const uint32_t layoutFileVersion = 2;
+static const uint32_t layoutFileByteOrder = 0x01020304;
+static const uint64_t layoutFileAlignment = 64;
+
+enum LayoutArray_ {
+  LayoutArray_SegmentStart,
+  LayoutArray_SegmentEnd,
+  LayoutArray_SegmentDirection,
+  LayoutArray_SegmentLength,
+  LayoutArray_SegmentNext,
+  LayoutArray_SegmentSwitch,
+  LayoutArray_SwitchApproach,
+  LayoutArray_SwitchNormal,
+  LayoutArray_SwitchReverse,
+  LayoutArray_SwitchReversed,
+  LayoutArray_LegSegments,
+  LayoutArray_LegBegin,
+  LayoutArray_SignalSegment,
+  LayoutArray_SignalOffset,
+  LayoutArray_Count
+};
+
+struct LayoutFileArray {
+  uint64_t offset; // From the start of the file
+  uint64_t count;
+};
+
+struct LayoutFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t arrayCount;
+  uint32_t reserved;
+  uint64_t fileSize;
+};
+
+// Writes the network to `path`; false on failure
+bool SaveLayout(const char *path, const TrackNetwork &network);
+// Maps `path` and points the network's arrays into it; false, leaving the
+// network untouched, if the file cannot be read or is not a layout this
+// version understands. The mapping lasts as long as any copy of an array.
+bool LoadLayout(const char *path, TrackNetwork *network);
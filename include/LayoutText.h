@@ -0,0 +1,31 @@
+#pragma once
+#include "JobSystem.h"
+#include "TrackNetwork.h"
+
+// Human-edited track layouts, one record per line:
+//
+//   segment <id> <start x> <start y> <end x> <end y>
+//   connect <from segment> <to segment>
+//   switch <approach> <normal> <reverse>
+//   signal <segment> <offset along it>
+//
+// Blank lines and text after '#' are ignored. Segment ids run from 0 with
+// none missing; switches and signals are numbered in file order. Records
+// may come in any order, as references are checked once the whole file is
+// read.
+//
+// Import streams the file in blocks, splits each block into chunks at line
+// boundaries and parses the chunks on the job system, so memory stays at a
+// block plus the parsed records however large the file is.
+struct LayoutTextError {
+  long long line = 0; // From 1, or 0 when no one line is at fault
+  char message[96] = "";
+};
+
+// Replaces the network with the layout in `path`; false, leaving the
+// network untouched and describing the first problem in error, if the file
+// cannot be read or is not a valid layout
+bool ImportLayoutText(const char *path, TrackNetwork *network, JobSystem *jobs,
+                      LayoutTextError *error);
+// Writes the network in the same format; false on failure
+bool ExportLayoutText(const char *path, const TrackNetwork &network);
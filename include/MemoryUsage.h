@@ -0,0 +1,28 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+// Parts of the program that memory is accounted to
+enum MemorySubsystem_ {
+  MemorySubsystem_ImGui,
+  MemorySubsystem_TrackGeometry,
+  MemorySubsystem_Simulation,
+  MemorySubsystem_COUNT
+};
+
+// Heap memory a structure holds: its blocks and their bytes, counting
+// capacity reserved but not yet used
+struct MemoryUsage {
+  size_t bytes = 0;
+  size_t blocks = 0;
+
+  void Add(size_t blockBytes) {
+    if (blockBytes > 0) {
+      bytes += blockBytes;
+      blocks++;
+    }
+  }
+  template <typename T> void Add(const std::vector<T> &items) {
+    Add(items.capacity() * sizeof(T));
+  }
+};
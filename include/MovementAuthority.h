@@ -0,0 +1,52 @@
+#pragma once
+#include "Arena.h"
+#include "BitSet.h"
+#include "Headway.h"
+#include "TrackNetwork.h"
+#include "TrainDynamics.h"
+#include "TrainFleet.h"
+#include <vector>
+
+// How far each train may run before the next obstruction (an occupied or
+// unreserved segment, or the end of track) and the highest speed from
+// which it can still stop there.
+//
+// Look-ahead distances are cached per segment as the clear distance beyond
+// its end, shared by every train behind it, and rebuilt lazily once the
+// occupancy or reservations change. A tick then costs one cached lookup
+// per train plus the segments whose cached distance had to be rebuilt.
+struct MovementAuthority {
+  float maxLookahead = 1000.0f;
+  float stoppingMargin = 0.0f; // Left between the stopped train and the end
+
+  std::vector<float> distance;   // Per train
+  std::vector<float> speedLimit; // Per train
+
+  // Call when occupancy or reserved segments change; everything is rebuilt
+  // on demand during the next Compute()
+  void Invalidate() { epoch++; }
+
+  // reserved may be null when routes are not in use. intervals may be null,
+  // in which case other trains on a head's own segment are not seen. Each
+  // train's stock is taken from trains. The segments walked while
+  // rebuilding are listed in scratch.
+  void Compute(const TrackNetwork &network, const BitSet &occupied,
+               const BitSet *reserved, const HeadwayMonitor *intervals,
+               const TrainFleet &fleet, const PackedTrain *trains,
+               const std::vector<StockTables> &tables, Arena *scratch);
+  void AddMemoryUsage(MemoryUsage *usage) const {
+    usage->Add(distance);
+    usage->Add(speedLimit);
+    usage->Add(clearBeyond);
+    usage->Add(clearEpoch);
+  }
+
+private:
+  float ClearBeyond(const TrackNetwork &network, const BitSet &occupied,
+                    const BitSet *reserved, int segment,
+                    ArenaVector<int> *chain);
+
+  std::vector<float> clearBeyond;
+  std::vector<unsigned> clearEpoch;
+  unsigned epoch = 1;
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include "BitSet.h"
+#include "MemoryUsage.h"
+#include <vector>
+
+// Which trains occupy which segments, for track-circuit style queries.
+// Each (segment, train) pair is a pooled node linked into both the
+// segment's occupant list and the train's tail-to-head segment list, so
+// the lists are maintained without allocating once the pool has grown.
+// Callers report head and tail segments as trains move, making the cost of
+// a tick proportional to boundary crossings rather than fleet size.
+struct Occupancy {
+  BitSet occupied; // One bit per segment with at least one occupant
+
+  void Resize(int segmentCount);
+  bool IsClear(int segment) const { return !occupied.Test(segment); }
+
+  // Records that the train now spans tailSegment to headSegment. The head
+  // must be reported on every segment it enters.
+  void Advance(int train, int headSegment, int tailSegment);
+  void Remove(int train);
+
+  // Walk a segment's occupants with
+  // for (int n = FirstOccupant(s); n >= 0; n = NextOccupant(n)) TrainOf(n)
+  int FirstOccupant(int segment) const { return segmentFirst[segment]; }
+  int NextOccupant(int node) const { return nodeSegmentNext[node]; }
+  int TrainOf(int node) const { return nodeTrain[node]; }
+  int OccupantCount(int segment) const;
+
+  // Walk a train's segments from tail to head with
+  // for (int n = TailNode(t); n >= 0; n = NextTowardHead(n)) SegmentOf(n)
+  int TailNode(int train) const {
+    return train < (int)trainTail.size() ? trainTail[train] : -1;
+  }
+  int NextTowardHead(int node) const { return nodeTowardHead[node]; }
+  int SegmentOf(int node) const { return nodeSegment[node]; }
+
+  void AddMemoryUsage(MemoryUsage *usage) const;
+
+private:
+  void Enter(int train, int segment);
+  void LeaveTail(int train);
+
+  std::vector<int> segmentFirst;
+  std::vector<int> trainTail; // Node of the train's rearmost segment
+  std::vector<int> trainHead;
+
+  std::vector<int> nodeTrain;
+  std::vector<int> nodeSegment;
+  std::vector<int> nodeSegmentPrev;
+  std::vector<int> nodeSegmentNext;
+  std::vector<int> nodeTowardHead;
+  int freeNode = -1;
+};
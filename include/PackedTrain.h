@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+
+// What a tick needs of a train besides the float lanes of its TrainFleet,
+// which the kinematics vectorise over, in 8 bytes rather than the 12 of
+// plain fields. Only the line speed is quantised, to 1/256 unit per second
+// up to 256, and only when it is set. Offsets stay float lanes in the
+// fleet, as rounding them every tick would let the tail drift from the
+// head.
+struct PackedTrain {
+  static constexpr float speedStep = 1.0f / 256;
+
+  int32_t tailSegment;
+  uint16_t lineSpeed;
+  uint16_t stock; // Index into the rolling stock tables
+
+  float LineSpeed() const { return lineSpeed * speedStep; }
+  void SetLineSpeed(float value) { lineSpeed = PackSpeed(value); }
+
+private:
+  static uint16_t PackSpeed(float value) {
+    float steps = value / speedStep + 0.5f;
+    return steps <= 0.0f ? 0 : steps >= 65535.0f ? 65535 : (uint16_t)steps;
+  }
+};
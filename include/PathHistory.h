@@ -0,0 +1,33 @@
+#pragma once
+#include "imgui.h"
+
+// Where a train has been: a point in track units and the segment it was on
+struct PathPoint {
+  ImVec2 point;
+  int segment;
+};
+
+// Recent path of a train head as a fixed-size ring buffer of samples keyed
+// by cumulative distance travelled, so cars can be placed along the actual
+// route with a binary search and recording never allocates.
+struct PathHistory {
+  static const int capacity = 256;
+  // The newest sample is replaced while it is closer than this to the one
+  // before it, so slow movement does not flush the buffer
+  float minSpacing = 0.25f;
+
+  float distance[capacity];
+  PathPoint samples[capacity];
+  int oldest = 0;
+  int count = 0;
+
+  void Clear() { oldest = count = 0; }
+  void Record(ImVec2 point, int segment);
+
+  // Position `behind` track units back along the path from the newest
+  // sample. Past the oldest sample the path is extended in a straight line.
+  PathPoint PointBehind(float behind) const;
+
+private:
+  int Physical(int logical) const { return (oldest + logical) % capacity; }
+};
@@ -0,0 +1,28 @@
+#pragma once
+#include "TrackNetwork.h"
+
+// Track layouts from railML 2 infrastructure files. Each <track> becomes a
+// run of segments from its trackBegin to its trackEnd, split at its
+// switches and geoMappings and placed by the geoCoords on those elements
+// (x east, y north, with y flipped so north is up on screen). Signals are
+// placed by their pos along the track.
+//
+// A trackEnd connection to another track's trackBegin joins the two. A
+// switch whose connection leads to the trackBegin of another track becomes
+// a switch with that track as its reverse leg; one whose connection comes
+// from another track's trackEnd merges that track in. Segments only run
+// from trackBegin to trackEnd, so connections joining two begins or two
+// ends, connections to ids not in the file and crossings are left out.
+//
+// The file is read as a stream of tags rather than as a document. Only the
+// current track and the connections seen so far are held, so memory grows
+// with the network rather than with the file.
+struct RailmlError {
+  long long line = 0; // From 1, or 0 when no one line is at fault
+  char message[96] = "";
+};
+
+// Replaces the network with the infrastructure in `path`; false, leaving
+// the network untouched and describing the first problem in error, if the
+// file cannot be read or is not railML this importer understands
+bool ImportRailml(const char *path, TrackNetwork *network, RailmlError *error);
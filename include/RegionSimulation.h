@@ -0,0 +1,112 @@
+#pragma once
+#include "BitSet.h"
+#include "Simulation.h"
+#include "SpscQueue.h"
+#include "TrackNetwork.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A train leaving one region for another, as it stood at the end of a tick
+struct TrainHandoff {
+  int id;
+  int headSegment;
+  float headOffset;
+  int tailSegment;
+  float tailOffset;
+  float speed;
+  float acceleration;
+  int stock;
+  float lineSpeed;
+};
+
+// Assigns contiguous runs of segment indices to regions, balancing the
+// segment count
+std::vector<int> PartitionSegments(const TrackNetwork &network,
+                                   int regionCount);
+
+// A simulation split into regions of the network, each owned by a worker
+// thread of its own, pinned to a core where the platform allows, which
+// steps the trains whose heads lie in the region. A region's trains so
+// stay in its core's cache from tick to tick. Trains whose heads cross into
+// another region are handed over through a lock-free queue per pair of
+// regions, always pushed by the one region's thread and popped by the
+// other's, and adopted once every region has stepped. Regions see each
+// other's trains through the union of their occupancy, rebuilt at the end
+// of every tick.
+//
+// Trains keep the id AddTrain gives them for as long as they run.
+struct RegionSimulation {
+  static const int queueCapacity = 1024;
+
+  std::vector<int> segmentRegion;
+  BitSet occupied;              // Union of every region's occupancy
+  std::vector<int> trainRegion; // By train id
+  std::vector<TrainHandle> trainHandle; // By train id, in its region
+
+  RegionSimulation() {}
+  RegionSimulation(const RegionSimulation &) = delete;
+  RegionSimulation &operator=(const RegionSimulation &) = delete;
+  ~RegionSimulation() { StopWorkers(); }
+
+  // regionOfSegment gives each segment's region, numbered from 0; starts a
+  // worker for each
+  void Build(const TrackNetwork &network,
+             const std::vector<int> &regionOfSegment,
+             const std::vector<StockTables> &stock);
+  int RegionCount() const { return (int)regions.size(); }
+  const Simulation &Region(int region) const {
+    return regions[region]->simulation;
+  }
+  // The train's index in its region's fleet
+  int TrainIndex(int id) const {
+    return Region(trainRegion[id]).Find(trainHandle[id]);
+  }
+
+  int AddTrain(const TrackNetwork &network, int headSegment, float headOffset,
+               float length, int stockIndex, float trainLineSpeed);
+  // Runs one tick on the region workers, returning once all are done
+  void Step(const TrackNetwork &network, float dt);
+
+private:
+  // What the workers do next, each for its own region
+  enum Phase { Phase_Step, Phase_Adopt, Phase_Merge, Phase_Stop };
+
+  struct RegionState {
+    Simulation simulation;
+    std::vector<int> slotId; // Train ids by handle slot in the simulation
+  };
+
+  SpscQueue<TrainHandoff> &Queue(int from, int to) {
+    return *queues[from * RegionCount() + to];
+  }
+  void Adopt(const TrackNetwork &network, int region);
+  void SetTrainId(int region, int train, int id);
+  void HandOver(int region);
+  bool MergeOccupancy(int wordBegin, int wordEnd);
+
+  void RunPhase(Phase phase);
+  void RunRegion(Phase phase, int region);
+  void WorkerLoop(int region);
+  void StopWorkers();
+
+  std::vector<std::unique_ptr<RegionState>> regions;
+  std::vector<std::unique_ptr<SpscQueue<TrainHandoff>>> queues;
+  bool occupancyChanged = true;
+
+  // The tick being run, for the workers
+  const TrackNetwork *stepNetwork = nullptr;
+  float stepDt = 0.0f;
+  std::atomic<bool> mergeChanged{false};
+
+  std::vector<std::thread> workers;
+  std::mutex phaseMutex;
+  std::condition_variable phaseStart;
+  std::condition_variable phaseDone;
+  Phase phase = Phase_Step;
+  unsigned phaseCount = 0; // Phases started, so workers see each once
+  int running = 0;         // Workers yet to finish the current phase
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include "BitSet.h"
+#include "TrackNetwork.h"
+#include "imgui.h"
+#include <vector>
+
+// Bits of a segment's state; together they index the colour table
+enum SegmentState_ {
+  SegmentState_Occupied = 1 << 0,
+  SegmentState_Reserved = 1 << 1,
+  SegmentState_SwitchAgainst = 1 << 2,
+  SegmentState_Blocked = 1 << 3,
+  SegmentState_COUNT = 1 << 4
+};
+
+// Derives every segment's colour from its occupancy, route reservation and
+// switch state through a lookup table. Update() compares the input bitmaps a
+// word (64 segments) at a time against the previous tick and only looks up
+// colours for segments whose inputs changed.
+struct SegmentColors {
+  BitSet occupied;
+  BitSet reserved;
+  BitSet blocked;
+  ImU32 table[SegmentState_COUNT];
+
+  SegmentColors();
+  void Resize(int segmentCount);
+  // Recolour every segment on the next update, e.g. after editing the table
+  void RefreshAll() { refreshAll = true; }
+
+  // Returns the number of segments whose colour changed, listed in changed
+  int Update(const TrackNetwork &network);
+  ImU32 Color(int segment) const { return colors[segment]; }
+
+  std::vector<int> changed;
+
+private:
+  BitSet switchAgainst;
+  BitSet lastOccupied;
+  BitSet lastReserved;
+  BitSet lastSwitchAgainst;
+  BitSet lastBlocked;
+  std::vector<unsigned char> lastSwitchReversed;
+  std::vector<ImU32> colors;
+  bool refreshAll = true;
+};
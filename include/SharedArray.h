@@ -0,0 +1,93 @@
+#pragma once
+#include <memory>
+#include <stddef.h>
+#include <vector>
+
+// Array whose storage is shared by its copies until one of them writes, so
+// copying a structure of arrays costs a reference count per array rather
+// than a pass over its elements. Reads look like std::vector's; writes go
+// through Set() or the growing calls, which copy the storage first if any
+// other array still shares it, or if it is a view of memory owned
+// elsewhere.
+//
+// Copies may be read and destroyed on other threads, but writes to an
+// array that has been copied must come from one thread at a time.
+template <typename T> class SharedArray {
+public:
+  SharedArray() {}
+  SharedArray(size_t count, const T &value) { assign(count, value); }
+  SharedArray(const SharedArray &) = default;
+  SharedArray &operator=(const SharedArray &) = default;
+  // A moved-from array is left empty, not pointing into storage it gave up
+  SharedArray(SharedArray &&other) noexcept
+      : storage(std::move(other.storage)), owner(std::move(other.owner)),
+        items(other.items), count(other.count) {
+    other.items = nullptr;
+    other.count = 0;
+  }
+  SharedArray &operator=(SharedArray &&other) noexcept {
+    if (this != &other) {
+      storage = std::move(other.storage);
+      owner = std::move(other.owner);
+      items = other.items;
+      count = other.count;
+      other.items = nullptr;
+      other.count = 0;
+    }
+    return *this;
+  }
+
+  // Reads `count` items in place, such as from a mapped file; `owner` keeps
+  // the memory alive for as long as any copy reads it
+  static SharedArray View(const T *items, size_t count,
+                          const std::shared_ptr<const void> &owner) {
+    SharedArray array;
+    array.owner = owner;
+    array.items = items;
+    array.count = count;
+    return array;
+  }
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  const T *data() const { return items; }
+  const T *begin() const { return items; }
+  const T *end() const { return items + count; }
+  const T &operator[](size_t i) const { return items[i]; }
+  const T &back() const { return items[count - 1]; }
+  // Heap bytes behind the array, which its copies may share; 0 for a view
+  size_t HeapBytes() const {
+    return storage ? storage->capacity() * sizeof(T) : 0;
+  }
+
+  void Set(size_t i, const T &value) { Own()[i] = value; }
+  void push_back(const T &value) {
+    Own().push_back(value);
+    Sync();
+  }
+  void assign(size_t newCount, const T &value) {
+    storage = std::make_shared<std::vector<T>>(newCount, value);
+    owner.reset();
+    Sync();
+  }
+  void clear() { *this = SharedArray(); }
+
+private:
+  std::vector<T> &Own() {
+    if (!storage || storage.use_count() > 1) {
+      storage = std::make_shared<std::vector<T>>(items, items + count);
+      owner.reset();
+      Sync();
+    }
+    return *storage;
+  }
+  void Sync() {
+    items = storage->data();
+    count = storage->size();
+  }
+
+  std::shared_ptr<std::vector<T>> storage;
+  std::shared_ptr<const void> owner; // Of viewed memory, when not storage
+  const T *items = nullptr;
+  size_t count = 0;
+};
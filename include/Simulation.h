@@ -0,0 +1,106 @@
+#pragma once
+#include "Arena.h"
+#include "BitSet.h"
+#include "Headway.h"
+#include "JobSystem.h"
+#include "MovementAuthority.h"
+#include "Occupancy.h"
+#include "PackedTrain.h"
+#include "TrackNetwork.h"
+#include "TrainDynamics.h"
+#include "TrainFleet.h"
+#include "TrainPool.h"
+#include <vector>
+
+// A simulation's trains as they stood at one tick: enough to rebuild it,
+// and nothing sized by the network, so taking one costs the same on any
+// network
+struct SimulationSnapshot {
+  TrainFleet fleet;
+  std::vector<PackedTrain> packed;
+  std::vector<int> reachedEnd;
+  TrainPool pool;
+  std::vector<StockTables> stock;
+  // Train i occupies trainSegments[trainSegmentsBegin[i]] to
+  // trainSegments[trainSegmentsBegin[i + 1]], head first
+  std::vector<int> trainSegments;
+  std::vector<int> trainSegmentsBegin;
+  float maxLookahead;
+  float stoppingMargin;
+};
+
+// A fleet of trains stepped one tick at a time. Movement authority and the
+// occupancy lists are shared structures and are updated on the calling
+// thread; the per-train passes in between run as chunks on the job system,
+// each chunk collecting the trains that crossed a boundary.
+//
+// Lists that only last the tick come from an arena per thread, reset as the
+// next tick starts, so a simulation whose fleet has stopped growing steps
+// without touching the heap.
+struct Simulation {
+  // Trains per job; small enough to balance, large enough to amortise
+  static const int chunkSize = 4096;
+  // Ticks between trimming the free slots from the end of the train pool
+  static const int compactInterval = 1024;
+
+  TrainFleet fleet;
+  TrainPool pool; // Handles to the trains, kept as their indices change
+  std::vector<StockTables> stock;
+  std::vector<PackedTrain> packed; // Per train, besides the fleet's lanes
+  Occupancy occupancy;
+  MovementAuthority authority;
+  std::vector<int> reachedEnd; // Trains stopped at the end of track
+  unsigned occupancyChanges = 0;
+
+  void Reset(const TrackNetwork &network);
+  // Places a train with its head at headOffset along headSegment and its
+  // tail `length` behind, following the track back from the head
+  int AddTrain(const TrackNetwork &network, int headSegment, float headOffset,
+               float length, int stockIndex, float trainLineSpeed);
+  // Places a train whose head and tail are both known, such as one handed
+  // over from another simulation, keeping its speed and acceleration
+  int PlaceTrain(const TrackNetwork &network, int headSegment,
+                 float headOffset, int backSegment, float backOffset,
+                 float trainSpeed, float trainAcceleration, int stockIndex,
+                 float trainLineSpeed);
+  // Removes a train by moving the last train into its index
+  void RemoveTrain(int train);
+  TrainHandle Handle(int train) const { return pool.Handle(train); }
+  // The train's index, or -1 once it has been removed
+  int Find(TrainHandle handle) const { return pool.Find(handle); }
+
+  // Copies out the trains; costs nothing per segment of the network
+  void Capture(SimulationSnapshot *snapshot) const;
+  // Replaces everything with the snapshot's trains, rebuilding occupancy
+  void Restore(const TrackNetwork &network,
+               const SimulationSnapshot &snapshot);
+  void AddMemoryUsage(MemoryUsage *usage) const;
+
+  // occupied may be null to use this simulation's own occupancy, or the
+  // union of several simulations' occupancy when they share a network.
+  // reserved and intervals are passed on to MovementAuthority::Compute.
+  // jobs may be null to step on the calling thread alone.
+  void Step(const TrackNetwork &network, const BitSet *occupied,
+            const BitSet *reserved, const HeadwayMonitor *intervals, float dt,
+            JobSystem *jobs);
+
+private:
+  // Trains of one chunk whose head or tail crossed into another segment
+  struct ChunkCrossings {
+    int *heads;
+    int headCount;
+    int *tails;
+    int tailCount;
+  };
+
+  int Add(const TrackNetwork &network, int headSegment, float headOffset,
+          int stockIndex, float trainLineSpeed);
+  // Occupies the listed segments, given head first
+  void Occupy(int train, const std::vector<int> &segments);
+  void StepChunk(const TrackNetwork &network, float dt, int chunk,
+                 Arena *arena, ChunkCrossings *crossings);
+
+  std::vector<Arena> arenas; // By JobSystem::ThreadIndex()
+  std::vector<int> placing;
+  int ticksSinceCompact = 0;
+};
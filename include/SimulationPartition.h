@@ -0,0 +1,130 @@
+#pragma once
+#include "BitSet.h"
+#include "RegionSimulation.h"
+#include "Simulation.h"
+#include "TrackNetwork.h"
+#include <stdint.h>
+#include <vector>
+
+enum PartitionMessageType_ {
+  PartitionMessage_Hello,     // First message on a connection
+  PartitionMessage_Handoff,   // A train whose head entered the receiver
+  PartitionMessage_Occupancy, // Sender's trains on 64 segments the receiver
+                              // can see
+  PartitionMessage_Horizon,   // Null message: nothing stamped before `tick`
+                              // is still to come
+};
+
+// Fixed-size record sent between partitions on the same host. Handoffs and
+// occupancy take effect at the start of `tick`.
+struct PartitionMessage {
+  int type;
+  int from; // Sending partition
+  int tick;
+  int word;
+  uint64_t bits;
+  TrainHandoff train;
+};
+
+// One process's share of a simulation partitioned across processes, which
+// talk over Unix domain sockets. Every process builds the same network and
+// partition; each steps the trains whose heads lie in its region.
+//
+// Synchronisation is conservative. After every tick a partition tells each
+// neighbour its horizon: the earliest tick at which it could still send
+// that neighbour anything. It works the horizon out from how soon any of
+// its trains could reach the segments the neighbour can see, and holds the
+// neighbour to the next tick while any train stands on one, as its next
+// step may free it. A partition whose trains are clear of a boundary so
+// lets its neighbours run ahead, yet every message takes effect at the
+// tick it was stamped for, and a run steps its trains exactly as one
+// process would.
+class SimulationPartition {
+public:
+  SimulationPartition(const TrackNetwork &network,
+                      const std::vector<int> &regionOfSegment, int self,
+                      const std::vector<StockTables> &stock, float dt);
+  ~SimulationPartition();
+
+  // Listens on <directory>/partition-<self>.sock and connects to every
+  // other partition; false on failure
+  bool Connect(const char *directory);
+
+  // Adds a train with the given id if its head lies in this region
+  bool AddTrain(int id, int headSegment, float headOffset, float length,
+                int stockIndex, float trainLineSpeed);
+
+  // Steps until `endTick`, waiting on neighbours only when a message they
+  // may still send could affect the next tick, then takes in the trains
+  // handed over on the last step; false if a link failed
+  bool Run(int endTick);
+  // Promises the neighbours nothing more and waits until they have done
+  // the same, so every partition can close its links safely
+  bool Finish();
+
+  int Tick() const { return tick; }
+  const Simulation &Local() const { return simulation; }
+  // The id AddTrain gave a train of the local simulation
+  int TrainId(int train) const {
+    return slotId[simulation.Handle(train).slot];
+  }
+
+  int handoffsSent = 0;
+  int nullMessagesSent = 0;
+  int waits = 0; // Ticks that had to wait for a neighbour
+
+private:
+  struct Neighbour {
+    int fd = -1;
+    int horizon = 0; // Ticks before this have all their messages
+    int promised = 0;
+    std::vector<char> outbox;
+    size_t outboxSent = 0;
+    std::vector<char> inbox;
+
+    BitSet occupied; // The neighbour's trains, as last reported
+    std::vector<int> interestWords; // Words of segments it can see
+    std::vector<uint64_t> interestMasks;
+    std::vector<uint64_t> lastSent;
+    std::vector<float> distance; // From each segment to what it can see
+    int entryTicks = 0; // Fewest ticks from entering here to being seen
+  };
+
+  void BuildInterest(int partition);
+  void BuildDistance(int partition);
+  void BuildEntryTicks(int partition);
+  int TicksUntilSeen(int partition, int segment, float offset, float speed,
+                     float trainLineSpeed) const;
+  // Whether a train from tailSegment up to headSegment stands on any
+  // segment the partition sees
+  bool HoldsSeen(int partition, int tailSegment, int headSegment) const;
+
+  void Send(int partition, const PartitionMessage &message);
+  bool Flush(int partition);
+  bool Receive(int partition);
+  bool Pump(bool block);
+  void Apply();
+  void HandOver();
+  void ReportOccupancy();
+  void PromiseHorizons();
+  void SetTrainId(int train, int id);
+
+  const TrackNetwork &network;
+  std::vector<int> segmentRegion;
+  int self;
+  float dt;
+  float topSpeed = 0.0f; // Fastest any rolling stock can run
+  int tick = 0;
+
+  Simulation simulation;
+  std::vector<int> slotId; // Train ids by handle slot in the simulation
+  std::vector<Neighbour> neighbours; // Indexed by partition; self unused
+  std::vector<PartitionMessage> pending; // Received, not yet due
+  BitSet handedOver; // Segments of trains handed over this tick
+  std::vector<int> handedSegments;
+  BitSet occupied;   // Everything this partition's trains must respect
+  std::vector<int> predecessors;
+  std::vector<int> predecessorBegin;
+  int listenFd = -1;
+  char listenPath[256];
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <stddef.h>
+#include <vector>
+
+// Allocator for many small blocks of varied size, such as ImGui's. Requests
+// are rounded up to a power-of-two class from 32 to 4096 bytes and carved
+// from 64 KB slabs; freed blocks go on their class's free list, so a
+// workload that has settled stops reaching malloc. Larger requests go to
+// malloc directly. A header in front of every block records its class and
+// size, so Free() needs only the pointer.
+//
+// Safe to call from several threads; each class has its own lock.
+class SizeClassPool {
+public:
+  static const int classCount = 8;
+
+  SizeClassPool() {}
+  SizeClassPool(const SizeClassPool &) = delete;
+  SizeClassPool &operator=(const SizeClassPool &) = delete;
+  ~SizeClassPool();
+
+  void *Allocate(size_t size);
+  void Free(void *block);
+
+  size_t LiveBytes() const { return liveBytes; } // As requested
+  size_t LiveBlocks() const { return liveBlocks; }
+  // Slabs plus blocks too large for a class, held from malloc
+  size_t ReservedBytes() const { return reservedBytes; }
+  unsigned long long Allocations() const { return allocations; }
+
+private:
+  // Keeps the blocks after it aligned as malloc's are
+  struct alignas(16) Header {
+    size_t size;
+    int sizeClass; // classCount for blocks from malloc
+  };
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+  struct SizeClass {
+    std::mutex mutex;
+    FreeBlock *free = nullptr;
+    char *unused = nullptr; // Rest of the newest slab
+    size_t unusedBytes = 0;
+    std::vector<char *> slabs;
+  };
+
+  SizeClass classes[classCount];
+  std::atomic<size_t> liveBytes{0};
+  std::atomic<size_t> liveBlocks{0};
+  std::atomic<size_t> reservedBytes{0};
+  std::atomic<unsigned long long> allocations{0};
+};
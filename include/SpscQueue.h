@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Each side keeps its index on its own cache line, along with a
+// cached copy of the other side's index, so the two cores only exchange
+// lines when the queue looks full or empty.
+template <typename T> class SpscQueue {
+public:
+  // Capacity is rounded up to a power of two
+  explicit SpscQueue(int capacity) {
+    int size = 1;
+    while (size < capacity) {
+      size *= 2;
+    }
+    items.resize(size);
+    mask = (unsigned)size - 1;
+  }
+
+  // Producer only; false when full
+  bool TryPush(const T &item) {
+    unsigned tail = writeIndex.load(std::memory_order_relaxed);
+    if (tail - cachedReadIndex > mask) {
+      cachedReadIndex = readIndex.load(std::memory_order_acquire);
+      if (tail - cachedReadIndex > mask) {
+        return false;
+      }
+    }
+    items[tail & mask] = item;
+    writeIndex.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only; false when empty
+  bool TryPop(T *item) {
+    unsigned head = readIndex.load(std::memory_order_relaxed);
+    if (head == cachedWriteIndex) {
+      cachedWriteIndex = writeIndex.load(std::memory_order_acquire);
+      if (head == cachedWriteIndex) {
+        return false;
+      }
+    }
+    *item = items[head & mask];
+    readIndex.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  static const int cacheLine = 64;
+
+  std::vector<T> items;
+  unsigned mask = 0;
+  char padBefore[cacheLine];
+
+  // Written by the producer
+  std::atomic<unsigned> writeIndex{0};
+  unsigned cachedReadIndex = 0;
+  char padBetween[cacheLine];
+
+  // Written by the consumer
+  std::atomic<unsigned> readIndex{0};
+  unsigned cachedWriteIndex = 0;
+  char padAfter[cacheLine];
+};
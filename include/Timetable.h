@@ -0,0 +1,74 @@
+#pragma once
+#include "TrackNetwork.h"
+#include <string>
+#include <vector>
+
+static const int secondsPerDay = 86400;
+
+// Days since 1970-01-01 of a calendar date
+int DayNumber(int year, int month, int day);
+// 0 for Monday to 6 for Sunday
+int Weekday(int dayNumber);
+
+// Scheduled trips of a GTFS-style feed, reduced to where and when each
+// train sets out. A feed is a directory of CSV files with a header row:
+//
+//   stop_times.txt      trip_id, departure_time, stop_id[, stop_sequence]
+//   stops.txt           stop_id, track_segment, track_offset
+//   trips.txt           trip_id, service_id
+//   calendar.txt        service_id, monday .. sunday, start_date, end_date
+//   calendar_dates.txt  service_id, date, exception_type
+//
+// stop_times.txt and stops.txt are required; the track columns of stops.txt
+// place each stop on the network, and GTFS readers ignore columns they do
+// not know. Without trips.txt every trip runs every day; with it, days of
+// service come from calendar.txt and calendar_dates.txt as in GTFS. A
+// trip sets out from its stop with the lowest stop_sequence, or its first
+// row without one, at that stop's departure_time, which may pass 24:00:00
+// for trips running past midnight.
+//
+// Trips are kept in departure order with an index by second of the day, so
+// finding the trips due in a tick costs two lookups however many there are.
+struct Timetable {
+  // Per trip, in departure order
+  std::vector<int> departure; // Seconds after the midnight of its day
+  std::vector<int> originSegment;
+  std::vector<float> originOffset;
+  std::vector<int> tripService;
+  std::vector<std::string> tripId;
+
+  // Per service: the weekdays it runs, bit 0 for Monday, between its first
+  // and last day; and the dates added or removed as service << 32 | day
+  std::vector<unsigned char> serviceWeekdays;
+  std::vector<int> serviceFirstDay;
+  std::vector<int> serviceLastDay;
+  std::vector<long long> addedDates;   // Sorted
+  std::vector<long long> removedDates; // Sorted
+
+  // firstAt[s] is the first trip departing at second s or later, for every
+  // second up to one past the last departure
+  std::vector<int> firstAt = std::vector<int>(1, 0);
+
+  int TripCount() const { return (int)departure.size(); }
+  int LastDeparture() const { return (int)firstAt.size() - 2; }
+  void Clear() { *this = Timetable(); }
+
+  bool Runs(int trip, int day) const;
+  // Trips departing from `from` up to but not including `to` seconds after
+  // midnight, as the range first to last
+  void DeparturesBetween(long long from, long long to, int *first,
+                         int *last) const;
+};
+
+struct TimetableError {
+  const char *file = ""; // Name within the feed
+  long long line = 0;    // From 1, or 0 when no one line is at fault
+  char message[96] = "";
+};
+
+// Replaces the timetable with the feed in `directory`, checking its stops
+// against the network; false, leaving the timetable untouched and
+// describing the first problem in error, if the feed cannot be read or is
+// not valid
+bool LoadTimetable(const char *directory, const TrackNetwork &network,
+                   Timetable *timetable, TimetableError *error);
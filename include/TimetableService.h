@@ -0,0 +1,46 @@
+#pragma once
+#include "Simulation.h"
+#include "Timetable.h"
+#include <vector>
+
+// A trip that fell due on a service day; days count from the one the clock
+// started on
+struct ScheduledTrip {
+  int trip;
+  int day;
+};
+
+// Runs a timetable on a simulation whose trains are all its own. As the
+// clock passes each departure the trip's train is placed with its tail at
+// the origin stop and its head a train length ahead; a departure whose
+// track is still occupied waits until it clears. Trains standing at the end
+// of track have finished their trip and are removed.
+struct TimetableService {
+  float trainLength = 4.0f;
+  float lineSpeed = 10.0f;
+  int stockIndex = 0;
+
+  int startDay = 0;     // Days since 1970-01-01 of the clock's first day
+  double clock = 0.0;   // Seconds since the midnight starting startDay
+  // The trip each train runs, by its handle slot; stale for free slots
+  std::vector<int> slotTrip;
+  std::vector<ScheduledTrip> waiting; // In the order they fell due
+  int departed = 0;
+  int held = 0; // Departures that had to wait for their track
+  int finished = 0;
+
+  // Restarts the clock at `seconds` after the midnight starting `day`; the
+  // simulation should be reset alongside
+  void Start(int day, double seconds);
+  // Removes the trains that have finished, then moves the clock on by dt
+  // and places the trains due by then. Step the simulation afterwards.
+  void Advance(const Timetable &timetable, const TrackNetwork &network,
+               Simulation *simulation, float dt);
+
+private:
+  bool Depart(const Timetable &timetable, const TrackNetwork &network,
+              Simulation *simulation, int trip);
+  void RemoveFinished(const TrackNetwork &network, Simulation *simulation);
+
+  std::vector<int> spanned;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+// Scoped timing for finding where frame and tick time goes. Builds define
+// RAILWAY_TRACE to record; otherwise TRACE_SCOPE expands to nothing and
+// costs nothing.
+//
+//   { TRACE_SCOPE("Input"); glfwPollEvents(); }
+//
+// Each thread records into a ring of its own without locking, keeping its
+// latest events, and SaveTrace() writes every thread's ring as Chrome
+// trace-event JSON, for chrome://tracing or Perfetto. Names must be string
+// literals, or otherwise outlive the trace, and free of quotes.
+#ifdef RAILWAY_TRACE
+#include <stdint.h>
+
+uint64_t TraceNow(); // Nanoseconds on a steady clock
+void TraceRecord(const char *name, uint64_t begin, uint64_t end);
+// Writes the events recorded so far; false if the file cannot be written
+bool SaveTrace(const char *path);
+
+class TraceScope {
+public:
+  explicit TraceScope(const char *name) : name(name), begin(TraceNow()) {}
+  ~TraceScope() { TraceRecord(name, begin, TraceNow()); }
+
+private:
+  const char *name;
+  uint64_t begin;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) (void)0
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+#include "MemoryUsage.h"
+#include "SharedArray.h"
+#include "imgui.h"
+
+// Track graph in track units. Segments and switches are stored as parallel
+// arrays so per-segment passes stay cache friendly on large networks. The
+// arrays are shared between copies until written, so a copy of the network
+// for a what-if branch costs the same however large the network is.
+struct TrackNetwork {
+  SharedArray<ImVec2> segmentStart;
+  SharedArray<ImVec2> segmentEnd;
+  SharedArray<ImVec2> segmentDirection; // Unit vector from start to end
+  SharedArray<float> segmentLength;
+  SharedArray<int> segmentNext;   // Following segment, or -1 at end of track
+  SharedArray<int> segmentSwitch; // Switch at the far end, or -1
+
+  SharedArray<int> switchApproach;
+  SharedArray<int> switchNormal;
+  SharedArray<int> switchReverse;
+  SharedArray<unsigned char> switchReversed;
+
+  // Segments controlled by each switch leg, up to the next switch or the end
+  // of track. Leg k of switch s spans legBegin[2s+k] to legBegin[2s+k+1].
+  SharedArray<int> legSegments;
+  SharedArray<int> legBegin = SharedArray<int>(1, 0);
+
+  SharedArray<int> signalSegment;
+  SharedArray<float> signalOffset; // Along its segment
+
+  int SegmentCount() const { return (int)segmentLength.size(); }
+  int SwitchCount() const { return (int)switchApproach.size(); }
+  int SignalCount() const { return (int)signalSegment.size(); }
+
+  void Clear() { *this = TrackNetwork(); }
+  void AddMemoryUsage(MemoryUsage *usage) const;
+  int AddSegment(ImVec2 start, ImVec2 end);
+  void Connect(int from, int to);
+  // Legs must already be connected, as the segments they control are
+  // collected when the switch is added
+  int AddSwitch(int approach, int normal, int reverse);
+  int AddSignal(int segment, float offset);
+
+  // Segment a train leaving `segment` runs onto, honouring switch positions
+  int NextSegment(int segment) const;
+  // Segment leading onto `segment` by any switch position, or -1. A scan
+  // over every segment, meant for placing trains rather than moving them.
+  int PreviousSegment(int segment) const;
+  ImVec2 PointAt(int segment, float offset) const;
+  // Distance along the segment of the point's projection onto it, clamped
+  float OffsetOf(int segment, ImVec2 point) const;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+// Every edit to a tracked value takes a stamp from one shared clock, so the
+// newest stamp among a derived value's inputs tells whether it is stale.
+inline unsigned NextVersion() {
+  static unsigned clock = 0;
+  return ++clock;
+}
+
+// A setting that remembers when it last changed. Reads convert to T so
+// arithmetic on settings looks the same as on plain fields.
+template <typename T> struct Tracked {
+  T value;
+  unsigned version;
+
+  Tracked(const T &initialValue)
+      : value(initialValue), version(NextVersion()) {}
+
+  operator const T &() const { return value; }
+
+  Tracked &operator=(const T &newValue) {
+    if (!(value == newValue)) {
+      value = newValue;
+      Touch();
+    }
+    return *this;
+  }
+  Tracked &operator+=(const T &delta) { return *this = value + delta; }
+
+  // Call after writing through &value (e.g. from an ImGui input widget)
+  void Touch() { version = NextVersion(); }
+};
+
+inline unsigned NewestVersion(unsigned version) { return version; }
+
+template <typename... Rest>
+unsigned NewestVersion(unsigned version, Rest... rest) {
+  unsigned newest = NewestVersion(rest...);
+  return version > newest ? version : newest;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "PackedTrain.h"
+#include "TrainFleet.h"
+#include <vector>
+
+// A force at a given speed on a tractive effort or braking force curve
+struct CurvePoint {
+  float speed;
+  float force;
+};
+
+// Performance of one kind of rolling stock. Curves are piecewise linear
+// and held flat past their last point.
+struct RollingStock {
+  float mass;
+  float maxSpeed;
+  std::vector<CurvePoint> tractiveEffort;
+  std::vector<CurvePoint> brakingForce;
+  // Davis running resistance A + B v + C v^2
+  float resistanceA;
+  float resistanceB;
+  float resistanceC;
+};
+
+// A rolling stock's curves sampled at even speed steps as accelerations,
+// built once at load time so a tick only interpolates between two samples
+struct StockTables {
+  static const int sampleCount = 128;
+
+  float speedStep;
+  float inverseSpeedStep;
+  float traction[sampleCount];   // Tractive effort less running resistance
+  float braking[sampleCount];    // Braking force plus running resistance
+  float minBraking;              // Weakest braking over the speed range
+};
+
+StockTables BuildStockTables(const RollingStock &stock);
+
+// Accelerates each train toward its target speed within what its traction
+// and brakes allow, taking each train's stock from trains. Positions are
+// advanced by UpdateKinematics.
+//
+// Uses AVX2, eight trains at a time, when the CPU supports it and a scalar
+// loop otherwise. Both round alike, so they give the same speeds.
+void StepDynamics(TrainFleet *fleet, const PackedTrain *trains,
+                  const std::vector<StockTables> &tables, float dt);
+// The same for trains [begin, end), for splitting the fleet across threads
+void StepDynamics(TrainFleet *fleet, const PackedTrain *trains,
+                  const std::vector<StockTables> &tables, float dt, int begin,
+                  int end);
+// The scalar loop on its own, regardless of CPU support
+void StepDynamicsScalar(TrainFleet *fleet, const PackedTrain *trains,
+                        const std::vector<StockTables> &tables, float dt,
+                        int begin, int end);
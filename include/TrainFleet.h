@@ -0,0 +1,30 @@
+#pragma once
+#include "TrackNetwork.h"
+#include <vector>
+
+// Trains as parallel arrays, so per-tick passes over the fleet stream
+// through memory. Train i's head is offset[i] along segment[i], at x[i],
+// y[i] in track units; its tail is tailOffset[i] along the segment its
+// owner keeps for it.
+struct TrainFleet {
+  std::vector<int> segment;
+  std::vector<float> offset;
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> speed;        // Track units per second
+  std::vector<float> acceleration; // Applied over the last tick
+  std::vector<float> targetSpeed;
+  std::vector<float> tailOffset;
+
+  int Count() const { return (int)segment.size(); }
+  void Clear() { *this = TrainFleet(); }
+  int Add(int headSegment, float headOffset);  // Tail at the head
+  void AddMemoryUsage(MemoryUsage *usage) const;
+};
+
+// Carries the `count` trains listed in crossed, whose offset ran past the
+// end of their segment, onto the next one. Trains reaching the end of track
+// stop there and are listed in reachedEnd.
+void CrossSegments(TrainFleet *fleet, const TrackNetwork &network,
+                   const int *crossed, int count,
+                   std::vector<int> *reachedEnd);
@@ -0,0 +1,47 @@
+#pragma once
+#include "MemoryUsage.h"
+#include <vector>
+
+// Names a train for as long as it runs, however its fleet index changes
+struct TrainHandle {
+  int slot = -1;
+  unsigned generation = 0;
+};
+
+// Hands out handles to a fleet's trains, which stay packed at the front of
+// their arrays by moving the last train into each one removed. A handle
+// names a slot holding its train's current index. Removing the train puts
+// the slot on a free list and bumps its generation, so old handles stop
+// resolving instead of naming whichever train reuses the slot.
+//
+// Free slots are reused before the table grows, lowest first after each
+// Compact(), which drops the free slots at the end of the table. Once
+// spawning and retiring settle, neither the table nor the fleet allocates.
+struct TrainPool {
+  // Call as the fleet grows by one train
+  TrainHandle Add(int train);
+  // Call before the fleet removes `train` by moving its last train there
+  void Remove(int train);
+  void Clear();
+  void Compact();
+
+  // The train's index, or -1 once it has been removed
+  int Find(TrainHandle handle) const;
+  TrainHandle Handle(int train) const;
+  int SlotCount() const { return (int)slotTrain.size(); }
+  int FreeCount() const { return freeCount; }
+  void AddMemoryUsage(MemoryUsage *usage) const {
+    usage->Add(slotTrain);
+    usage->Add(slotGeneration);
+    usage->Add(trainSlot);
+  }
+
+private:
+  // Slots on the free list hold -2 - the next free slot
+  std::vector<int> slotTrain;
+  std::vector<unsigned> slotGeneration;
+  std::vector<int> trainSlot;
+  int freeSlot = -1;
+  int freeCount = 0;
+  unsigned retiredGeneration = 0; // Above that of any slot Compact() dropped
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include "Simulation.h"
+#include "TrackNetwork.h"
+#include <atomic>
+#include <thread>
+
+// A what-if copy of a live simulation: forked at the current tick, changed
+// (a switch thrown, say) and run ahead on a thread of its own as fast as it
+// will go while the live simulation carries on, then read and discarded.
+//
+// Forking shares the live track graph and copies only the trains, so it
+// costs the same on any network; the branch rebuilds its occupancy on its
+// own thread. It runs without route reservations or headway intervals, so
+// it shows where the trains would physically go.
+class WhatIfBranch {
+public:
+  WhatIfBranch() : stopping(false), done(false), ticksRun(0) {}
+  ~WhatIfBranch() { Discard(); }
+
+  // Discards any earlier branch and copies the live state
+  void Fork(const TrackNetwork &network, const Simulation &live);
+  // The branch's own copy of the track, to change before Run()
+  TrackNetwork &Network() { return network; }
+
+  // Steps up to `ticks` ticks of dt, stopping early once every train stands
+  void Run(int ticks, float dt);
+  bool IsForked() const { return forked; }
+  bool IsDone() const { return done.load(); }
+  int TicksRun() const { return ticksRun.load(); }
+  // First tick a train reached the end of track, or -1; valid once done
+  int ReachedEndTick() const { return reachedEndTick; }
+  // Valid once done
+  const Simulation &Result() const { return simulation; }
+
+  // Stops a run in progress and drops the branch
+  void Discard();
+
+private:
+  void Step(int ticks, float dt);
+
+  TrackNetwork network;
+  SimulationSnapshot snapshot;
+  Simulation simulation;
+  bool forked = false;
+  int reachedEndTick = -1;
+  std::thread thread;
+  std::atomic<bool> stopping;
+  std::atomic<bool> done;
+  std::atomic<int> ticksRun;
+};
@@ -127,6 +127,12 @@
 //---- Debug Tools: Enable slower asserts
 //#define IMGUI_DEBUG_PARANOID
 
+//---- Keep the current context per thread, so worker threads filling draw lists (see DrawBatches.h) never touch it.
+// The pointer is defined in src/DrawBatches.cpp.
+struct ImGuiContext;
+extern thread_local ImGuiContext* ImGuiThreadContext;
+#define GImGui ImGuiThreadContext
+
 //---- Tip: You can add extra functions within the ImGui:: namespace from anywhere (e.g. your own sources/header files)
 /*
 namespace ImGui
@@ -4,119 +4,875 @@
 #include <stdio.h>
 #define GL_SILENCE_DEPRECATION
 #include "Colors.h"
+#include "DrawBatches.h"
+#include "Headway.h"
+#include "Interlocking.h"
+#include "JobSystem.h"
+#include "KineticHeadway.h"
+#include "LatencyHistogram.h"
+#include "LayoutFile.h"
+#include "LayoutText.h"
+#include "MemoryUsage.h"
+#include "PathHistory.h"
+#include "RailmlImport.h"
+#include "SegmentColors.h"
+#include "Simulation.h"
+#include "SizeClassPool.h"
+#include "Timetable.h"
+#include "TimetableService.h"
+#include "Trace.h"
+#include "TrackNetwork.h"
+#include "TrainDynamics.h"
+#include "Tracked.h"
+#include "WhatIfBranch.h"
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <string.h>
+#include <thread>
+#include <time.h>
 
 struct TrackSettings {
-  int trackLength = 45;
-  float trainHeadX = 10.0f;
-  float trainHeadY = 0.0f;
-  int trainLength = 5;
-  int switchPosition = 25;
-  int trackMultiplier = 18;
-  int framesPerMove = 30;
-  ImU32 mainTrackPart1Color = ORANGE;
-  ImU32 mainTrackPart2Color = ORANGE;
-  ImU32 divergentTrackColor = RED;
-  bool isSwitchFlipped = false;
-  bool isTrainMoving = false;
+  Tracked<int> trackLength = 45;
+  Tracked<float> trainHeadX = 10.0f;
+  Tracked<float> trainHeadY = 0.0f;
+  Tracked<int> trainLength = 5;
+  Tracked<int> switchPosition = 25;
+  Tracked<int> trackMultiplier = 18;
+  Tracked<int> framesPerMove = 30;
+  Tracked<bool> isSwitchFlipped = false;
+  Tracked<bool> isTrainMoving = false;
+  Tracked<bool> isTrainOffTrack = false;
 
   void Reset() { *this = TrackSettings(); }
 };
 
+// Segments of the demo network built from the settings
+enum DemoSegment {
+  MainTrackPart1,
+  MainTrackPart2,
+  DivergentSlope,
+  DivergentTrack
+};
+
+// Routes through the demo network
+enum DemoRoute { MainRoute, DivergentRoute };
+
+// A layout file shown in place of the demo network. Files ending .txt are
+// read as text layouts, .railml or .xml as railML and anything else as a
+// saved LayoutFile.
+struct LayoutImport {
+  char path[256] = "layout.txt";
+  char error[160] = "";
+  TrackNetwork network;
+  Tracked<bool> isImported = false;
+};
+
+// Track graph and screen-space geometry, rebuilt only when the settings they
+// are derived from have been edited. The demo routes and train only exist
+// on the demo network.
+struct TrackLayout {
+  TrackNetwork network;
+  ImVec2 anchor;           // Screen point the layout was placed against
+  ImVec2 origin;           // Screen point of the track origin
+  float unitLength = 0.0f; // Pixels per track unit
+  bool isDemo = true;
+  unsigned version = 0;
+
+  ImVec2 ToScreen(float trackX, float trackY) const {
+    return ImVec2(origin.x + trackX * unitLength,
+                  origin.y + trackY * unitLength);
+  }
+  ImVec2 ToScreen(ImVec2 trackPoint) const {
+    return ToScreen(trackPoint.x, trackPoint.y);
+  }
+};
+
+// Segment colours, with their inputs refreshed only when the train or switch
+// state changes
+struct TrackColors {
+  SegmentColors segments;
+  unsigned version = 0;
+  unsigned routeChanges = 0;
+};
+
+// Path of the train head, restarted whenever the head is placed by hand
+struct TrainPath {
+  PathHistory history;
+  unsigned version = 0;
+};
+
+// Headway conflicts between the demo train and the timetabled trains, and
+// conflicts predicted ahead, refreshed whenever any of them moves. The demo
+// train is supervised as train 0 and each timetabled train as 1 + the slot
+// of its handle, which stays its own for as long as it runs.
+struct TrainSupervision {
+  HeadwayMonitor headway;
+  std::vector<HeadwayConflict> conflicts;
+  KineticHeadway kinetic;
+  EventQueue events;
+  std::vector<ConflictWarning> warnings;
+  // Simulated seconds run by the timetabled trains, or by the demo train
+  // while no timetable runs, for the times of predicted conflicts
+  double clock = 0.0;
+  int scheduledCount = 0; // Timetabled trains last reported
+  unsigned version = 0;
+};
+
+// The demo train as a simulation of one, moved by the dynamics model
+struct TrainMotion {
+  Simulation simulation;
+  BitSet reserved;
+  unsigned routeChanges = 0;
+  unsigned version = 0; // Head position last written back to the settings
+};
+
+// Trains running to a timetable feed, on a simulation of their own beside
+// the demo train
+struct ScheduledTrains {
+  char directory[256] = "timetable";
+  Timetable timetable;
+  TimetableError error;
+  TimetableService service;
+  Simulation simulation;
+  bool isRunning = false;
+  int speedUp = 1;      // Ticks per frame
+  unsigned version = 0; // Layout the feed's stops were checked against
+};
+
+// Frame and simulation tick latencies, and the draw data of the latest
+// frame, for seeing stutter while the demo runs
+struct PerformanceStats {
+  static const int plotLength = 240; // Four seconds at 60 Hz
+  LatencyHistogram frames;           // Microseconds
+  LatencyHistogram ticks;
+  float frameMilliseconds[plotLength] = {};
+  float tickMilliseconds[plotLength] = {};
+  int plotNext = 0;
+  double frameEnd = 0.0; // When the last frame was swapped, in seconds
+  int drawCalls = 0;
+  int vertices = 0;
+
+  void Record(double frameSeconds, double tickSeconds) {
+    frames.Record((uint32_t)(frameSeconds * 1e6));
+    ticks.Record((uint32_t)(tickSeconds * 1e6));
+    frameMilliseconds[plotNext] = (float)(frameSeconds * 1000.0);
+    tickMilliseconds[plotNext] = (float)(tickSeconds * 1000.0);
+    plotNext = (plotNext + 1) % plotLength;
+  }
+
+  // Counts the commands the renderer will draw, batches included
+  void CountDrawData(const ImDrawData *drawData) {
+    drawCalls = 0;
+    for (int i = 0; i < drawData->CmdListsCount; i++) {
+      for (const ImDrawCmd &command : drawData->CmdLists[i]->CmdBuffer) {
+        drawCalls += command.ElemCount > 0 && !command.UserCallback;
+      }
+    }
+    vertices = drawData->TotalVtxCount;
+  }
+};
+
+// ImGui's allocations, pooled by size so the windows and draw lists that
+// come and go each frame reuse the same blocks
+static SizeClassPool imguiPool;
+
+static void *ImGuiAllocate(size_t size, void *pool) {
+  return ((SizeClassPool *)pool)->Allocate(size);
+}
+
+static void ImGuiFree(void *block, void *pool) {
+  ((SizeClassPool *)pool)->Free(block);
+}
+
 static void glfw_error_callback(int error, const char *description) {
   fprintf(stderr, "GLFW Error %d: %s\n", error, description);
 }
 
-void updateColors(TrackSettings *currentSettings) {
+// Scales an imported network to fit the area above and to the right of
+// origin, with its lowest point on origin's line
+void fitLayout(TrackLayout *layout, ImVec2 origin) {
+  const ImVec2 area = ImVec2(1180.0f, 400.0f);
+  const TrackNetwork &network = layout->network;
+  ImVec2 low = ImVec2(0, 0), high = ImVec2(0, 0);
+  if (network.SegmentCount() > 0) {
+    low = high = network.segmentStart[0];
+  }
+  for (int segment = 0; segment < network.SegmentCount(); segment++) {
+    ImVec2 ends[] = {network.segmentStart[segment],
+                     network.segmentEnd[segment]};
+    for (ImVec2 point : ends) {
+      low = ImVec2(std::min(low.x, point.x), std::min(low.y, point.y));
+      high = ImVec2(std::max(high.x, point.x), std::max(high.y, point.y));
+    }
+  }
+  float width = std::max(high.x - low.x, 1e-3f);
+  float height = std::max(high.y - low.y, 1e-3f);
+  layout->unitLength = std::min(area.x / width, area.y / height);
+  layout->origin = ImVec2(origin.x - low.x * layout->unitLength,
+                          origin.y - high.y * layout->unitLength);
+}
+
+void updateLayout(TrackLayout *layout, const TrackSettings &currentSettings,
+                  const LayoutImport &import, ImVec2 origin) {
+  unsigned inputsVersion = NewestVersion(
+      currentSettings.trackLength.version,
+      currentSettings.switchPosition.version,
+      currentSettings.trackMultiplier.version, import.isImported.version);
+  if (inputsVersion <= layout->version && origin.x == layout->anchor.x &&
+      origin.y == layout->anchor.y) {
+    return;
+  }
+
+  layout->anchor = origin;
+  if (import.isImported) {
+    layout->network = import.network;
+    layout->isDemo = false;
+    fitLayout(layout, origin);
+    layout->version = inputsVersion;
+    return;
+  }
+
+  // The divergent track rises this many track units over as many units
+  const float divergentRise = 5.0f;
+
+  float switchX = (float)currentSettings.switchPosition;
+  float endX = (float)currentSettings.trackLength;
+  ImVec2 bend = ImVec2(switchX + divergentRise, -divergentRise);
+
+  TrackNetwork &network = layout->network;
+  network.Clear();
+  network.AddSegment(ImVec2(0, 0), ImVec2(switchX, 0));
+  network.AddSegment(ImVec2(switchX, 0), ImVec2(endX, 0));
+  network.AddSegment(ImVec2(switchX, 0), bend);
+  network.AddSegment(bend, ImVec2(endX, -divergentRise));
+  network.Connect(DivergentSlope, DivergentTrack);
+  network.AddSwitch(MainTrackPart1, MainTrackPart2, DivergentSlope);
+
+  layout->isDemo = true;
+  layout->origin = origin;
+  layout->unitLength = (float)currentSettings.trackMultiplier;
+  layout->version = inputsVersion;
+}
+
+void updateInterlocking(Interlocking *interlocking, TrackLayout *layout,
+                        TrackSettings *currentSettings) {
+  TrackNetwork &network = layout->network;
+  if (!layout->isDemo) {
+    if (layout->version > interlocking->version) {
+      interlocking->Build(network, std::vector<Route>());
+      interlocking->version = layout->version;
+    }
+    currentSettings->isTrainMoving = false;
+    return;
+  }
+  if (layout->version > interlocking->version) {
+    std::vector<Route> routes(2);
+    routes[MainRoute].segments.push_back(MainTrackPart1);
+    routes[MainRoute].segments.push_back(MainTrackPart2);
+    routes[MainRoute].switches.push_back(0);
+    routes[MainRoute].switchReversed.push_back(0);
+    routes[DivergentRoute].segments.push_back(MainTrackPart1);
+    routes[DivergentRoute].segments.push_back(DivergentSlope);
+    routes[DivergentRoute].segments.push_back(DivergentTrack);
+    routes[DivergentRoute].switches.push_back(0);
+    routes[DivergentRoute].switchReversed.push_back(1);
+    interlocking->Build(network, routes);
+    interlocking->version = layout->version;
+  }
+
+  // Switch throws are refused while a route holds the switch
+  bool isSwitchReversed = network.switchReversed[0] != 0;
+  if (currentSettings->isSwitchFlipped != isSwitchReversed &&
+      !interlocking->ThrowSwitch(&network, 0,
+                                 currentSettings->isSwitchFlipped)) {
+    currentSettings->isSwitchFlipped = isSwitchReversed;
+  }
+
+  // The train may only move with its route set
+  int route = currentSettings->isSwitchFlipped ? DivergentRoute : MainRoute;
   if (currentSettings->isTrainMoving) {
-    currentSettings->mainTrackPart1Color = GREEN;
-    if (!currentSettings->isSwitchFlipped) {
-      currentSettings->mainTrackPart2Color = GREEN;
-      currentSettings->divergentTrackColor = RED;
-    } else {
-      currentSettings->mainTrackPart2Color = RED;
-      currentSettings->divergentTrackColor = GREEN;
+    if (!interlocking->IsRouteSet(route) &&
+        !interlocking->RequestRoute(&network, route)) {
+      currentSettings->isTrainMoving = false;
     }
   } else {
-    currentSettings->mainTrackPart1Color = ORANGE;
-    if (!currentSettings->isSwitchFlipped) {
-      currentSettings->mainTrackPart2Color = ORANGE;
-      currentSettings->divergentTrackColor = RED;
+    interlocking->ReleaseRoute(MainRoute);
+    interlocking->ReleaseRoute(DivergentRoute);
+  }
+}
+
+void updateColors(TrackColors *colors, const TrackLayout &layout,
+                  const Interlocking &interlocking, const Occupancy &demo,
+                  const Occupancy &timetabled,
+                  const TrackSettings &currentSettings) {
+  unsigned inputsVersion =
+      NewestVersion(layout.version, currentSettings.isTrainMoving.version,
+                    currentSettings.isTrainOffTrack.version);
+  if (inputsVersion > colors->version ||
+      interlocking.ChangeCount() != colors->routeChanges) {
+    const TrackNetwork &network = layout.network;
+    SegmentColors &segments = colors->segments;
+    if (layout.version > colors->version) {
+      segments.Resize(network.SegmentCount());
+    }
+
+    interlocking.ReservedSegments(&segments.reserved);
+
+    if (currentSettings.isTrainOffTrack && !currentSettings.isTrainMoving) {
+      segments.blocked.SetAll();
     } else {
-      currentSettings->mainTrackPart2Color = RED;
-      currentSettings->divergentTrackColor = ORANGE;
+      segments.blocked.ClearAll();
+    }
+    colors->version = inputsVersion;
+    colors->routeChanges = interlocking.ChangeCount();
+  }
+  // Occupied by the demo train or any timetabled train. Either simulation
+  // may not have been sized for the layout yet.
+  BitSet &occupied = colors->segments.occupied;
+  for (int w = 0; w < occupied.WordCount(); w++) {
+    uint64_t word = 0;
+    if (w < demo.occupied.WordCount()) {
+      word |= demo.occupied.words[w];
+    }
+    if (w < timetabled.occupied.WordCount()) {
+      word |= timetabled.occupied.words[w];
     }
+    occupied.words[w] = word;
   }
+
+  colors->segments.Update(layout.network);
 }
 
-void RenderDialog(TrackSettings *currentSettings) {
-  // Track Control Dialog Box
-  ImGui::Begin("Track Controls");
-  ImGui::SetNextItemWidth(100);
-  ImGui::InputInt("Track Length", &currentSettings->trackLength);
-  ImGui::SetNextItemWidth(100);
-  ImGui::InputFloat("Train Head Position", &currentSettings->trainHeadX);
-  ImGui::SetNextItemWidth(100);
-  ImGui::InputInt("Train Length", &currentSettings->trainLength);
-  ImGui::SetNextItemWidth(100);
-  ImGui::InputInt("Switch Position", &currentSettings->switchPosition);
+int demoSegmentAt(const TrackNetwork &network, float trackX, float trackY) {
+  if (trackY < 0) {
+    return trackX < network.segmentEnd[DivergentSlope].x ? DivergentSlope
+                                                         : DivergentTrack;
+  }
+  return trackX < network.segmentEnd[MainTrackPart1].x ? MainTrackPart1
+                                                       : MainTrackPart2;
+}
+
+void updateTrainPath(TrainPath *path, const TrackLayout &layout,
+                     const TrackSettings &currentSettings, bool hasMoved) {
+  unsigned headVersion =
+      NewestVersion(layout.version, currentSettings.trainHeadX.version,
+                    currentSettings.trainHeadY.version);
+  if (headVersion <= path->version) {
+    return;
+  }
+  if (!hasMoved) {
+    path->history.Clear();
+  }
+  path->history.Record(
+      ImVec2(currentSettings.trainHeadX, currentSettings.trainHeadY),
+      demoSegmentAt(layout.network, currentSettings.trainHeadX,
+                    currentSettings.trainHeadY));
+  path->version = headVersion;
+}
+
+RollingStock demoStock() {
+  // A light railcar, with one track unit taken as one metre
+  RollingStock stock;
+  stock.mass = 40000.0f;
+  stock.maxSpeed = 20.0f;
+  CurvePoint traction[] = {{0.0f, 40000.0f}, {4.0f, 40000.0f},
+                           {10.0f, 16000.0f}, {20.0f, 8000.0f}};
+  CurvePoint braking[] = {{0.0f, 48000.0f}, {20.0f, 40000.0f}};
+  stock.tractiveEffort.assign(traction, traction + 4);
+  stock.brakingForce.assign(braking, braking + 2);
+  stock.resistanceA = 600.0f;
+  stock.resistanceB = 10.0f;
+  stock.resistanceC = 1.5f;
+  return stock;
+}
+
+void updateTrainMotion(TrainMotion *motion, TrainPath *path,
+                       const TrackLayout &layout,
+                       const Interlocking &interlocking,
+                       const TrainSupervision &supervision,
+                       TrackSettings *currentSettings, JobSystem *jobs) {
+  const TrackNetwork &network = layout.network;
+  Simulation &simulation = motion->simulation;
+  TrainFleet &fleet = simulation.fleet;
+  if (simulation.stock.empty()) {
+    simulation.stock.push_back(BuildStockTables(demoStock()));
+  }
+  if (!layout.isDemo) {
+    if (layout.version > motion->version) {
+      simulation.Reset(network);
+      path->history.Clear();
+      motion->version = layout.version;
+    }
+    currentSettings->isTrainOffTrack = false;
+    return;
+  }
+
+  // With vsync the frame is a sixtieth of a second, and the line speed is
+  // one track unit every framesPerMove frames
+  const float framesPerSecond = 60.0f;
+  int framesPerMove = currentSettings->framesPerMove;
+  float lineSpeed = framesPerSecond / (framesPerMove > 1 ? framesPerMove : 1);
+
+  // Place the train again when its head was set by hand or the track changed
+  unsigned headVersion =
+      NewestVersion(layout.version, currentSettings->trainHeadX.version,
+                    currentSettings->trainHeadY.version,
+                    currentSettings->trainLength.version);
+  if (fleet.Count() == 0 || headVersion > motion->version) {
+    ImVec2 head =
+        ImVec2(currentSettings->trainHeadX, currentSettings->trainHeadY);
+    int segment = demoSegmentAt(network, head.x, head.y);
+    simulation.Reset(network);
+    simulation.AddTrain(network, segment, network.OffsetOf(segment, head),
+                        (float)(currentSettings->trainLength - 1), 0,
+                        lineSpeed);
+    updateTrainPath(path, layout, *currentSettings, false);
+    motion->version = headVersion;
+  }
+  simulation.packed[0].SetLineSpeed(lineSpeed);
+
+  if (!currentSettings->isTrainMoving) {
+    fleet.speed[0] = 0.0f;
+    fleet.acceleration[0] = 0.0f;
+    return;
+  }
+
+  // Brake for the end of the route or anything occupying it
+  if (interlocking.ChangeCount() != motion->routeChanges) {
+    motion->reserved.Resize(network.SegmentCount());
+    interlocking.ReservedSegments(&motion->reserved);
+    simulation.authority.Invalidate();
+    motion->routeChanges = interlocking.ChangeCount();
+  }
+  simulation.Step(network, nullptr, &motion->reserved, &supervision.headway,
+                  1.0f / framesPerSecond, jobs);
+
+  currentSettings->trainHeadX = fleet.x[0];
+  currentSettings->trainHeadY = fleet.y[0];
+  motion->version =
+      NewestVersion(layout.version, currentSettings->trainHeadX.version,
+                    currentSettings->trainHeadY.version,
+                    currentSettings->trainLength.version);
+  updateTrainPath(path, layout, *currentSettings, true);
+
+  // Stop the train if it runs off the track
+  currentSettings->isTrainOffTrack = !simulation.reachedEnd.empty();
+  if (currentSettings->isTrainOffTrack) {
+    currentSettings->isTrainMoving = false;
+  }
+}
+
+void updateScheduledTrains(ScheduledTrains *scheduled,
+                           const TrackLayout &layout, JobSystem *jobs) {
+  const TrackNetwork &network = layout.network;
+  Simulation &simulation = scheduled->simulation;
+  // The stops may no longer be where the feed put them
+  if (scheduled->isRunning && layout.version > scheduled->version) {
+    scheduled->isRunning = false;
+    simulation.Reset(network);
+  }
+  if (!scheduled->isRunning) {
+    return;
+  }
+
+  const float framesPerSecond = 60.0f;
+  for (int tick = 0; tick < scheduled->speedUp; tick++) {
+    scheduled->service.Advance(scheduled->timetable, network, &simulation,
+                               1.0f / framesPerSecond);
+    simulation.Step(network, nullptr, nullptr, nullptr,
+                    1.0f / framesPerSecond, jobs);
+  }
+}
+
+void updateSupervision(TrainSupervision *supervision,
+                       const TrackLayout &layout, const TrainPath &path,
+                       const Simulation &simulation,
+                       const ScheduledTrains &scheduled) {
+  const TrackNetwork &network = layout.network;
+  if (layout.version > supervision->version) {
+    supervision->headway.Resize(network.SegmentCount());
+    supervision->events.Clear();
+    supervision->warnings.clear();
+  }
+
+  // Timetabled trains move every tick, and Detect() forgets any train not
+  // reported since the last call, so all are reported while any run
+  const int train = 0;
+  const TrainFleet &fleet = simulation.fleet;
+  const Simulation &timetabled = scheduled.simulation;
+  int scheduledCount = scheduled.isRunning ? timetabled.fleet.Count() : 0;
+  unsigned inputsVersion = NewestVersion(layout.version, path.version);
+  bool hasDemoTrain = fleet.Count() > 0;
+  if (inputsVersion > supervision->version || scheduledCount > 0 ||
+      supervision->scheduledCount > 0) {
+    if (hasDemoTrain) {
+      supervision->headway.UpdateTrain(network, simulation.occupancy, train,
+                                       train, fleet.tailOffset[train],
+                                       fleet.offset[train]);
+    }
+    for (int i = 0; i < scheduledCount; i++) {
+      supervision->headway.UpdateTrain(
+          network, timetabled.occupancy, i, 1 + timetabled.Handle(i).slot,
+          timetabled.fleet.tailOffset[i], timetabled.fleet.offset[i]);
+    }
+    supervision->headway.Detect(network, &supervision->conflicts);
+    supervision->scheduledCount = scheduledCount;
+    supervision->version = inputsVersion;
+  }
+
+  // Timetabled trains run speedUp ticks a frame and the demo train one, so
+  // on the timetabled trains' clock the demo train runs speedUp times slower
+  const float framesPerSecond = 60.0f;
+  int speedUp = scheduled.isRunning ? std::max(scheduled.speedUp, 1) : 1;
+  supervision->clock += speedUp / framesPerSecond;
+  double now = supervision->clock;
+  if (hasDemoTrain) {
+    supervision->kinetic.SetMotion(
+        train, fleet.speed[train] / speedUp,
+        fleet.acceleration[train] / ((float)speedUp * speedUp));
+  }
+  for (int i = 0; i < scheduledCount; i++) {
+    supervision->kinetic.SetMotion(1 + timetabled.Handle(i).slot,
+                                   timetabled.fleet.speed[i],
+                                   timetabled.fleet.acceleration[i]);
+  }
+  supervision->kinetic.Refresh(network, supervision->headway, now,
+                               &supervision->events);
+
+  // Warnings stand until their certificate is re-solved or given up; a
+  // conflict that is still coming is warned of again by its new event
+  SimEvent event;
+  while (supervision->events.PopDue(now, &event)) {
+    supervision->kinetic.HandleEvent(event, &supervision->warnings);
+  }
+  std::vector<ConflictWarning> &warnings = supervision->warnings;
+  size_t kept = 0;
+  for (const ConflictWarning &warning : warnings) {
+    if (supervision->kinetic.IsCurrent(warning)) {
+      warnings[kept++] = warning;
+    }
+  }
+  warnings.resize(kept);
+}
+
+void InputSetting(const char *label, Tracked<int> *setting) {
   ImGui::SetNextItemWidth(100);
-  ImGui::InputInt("Track Multiplier", &currentSettings->trackMultiplier);
+  if (ImGui::InputInt(label, &setting->value)) {
+    setting->Touch();
+  }
+}
+
+void InputSetting(const char *label, Tracked<float> *setting) {
   ImGui::SetNextItemWidth(100);
-  ImGui::InputInt("Frames Per Move", &currentSettings->framesPerMove);
-  if (ImGui::Checkbox("Is Switch Flipped", &currentSettings->isSwitchFlipped)) {
-    updateColors(currentSettings);
+  if (ImGui::InputFloat(label, &setting->value)) {
+    setting->Touch();
   }
-  if (ImGui::Checkbox("Is Train Moving", &currentSettings->isTrainMoving)) {
-    updateColors(currentSettings);
+}
+
+void InputSetting(const char *label, Tracked<bool> *setting) {
+  if (ImGui::Checkbox(label, &setting->value)) {
+    setting->Touch();
   }
+}
+
+void RenderDialog(TrackSettings *currentSettings) {
+  TRACE_SCOPE("RenderDialog");
+  // Track Control Dialog Box
+  ImGui::Begin("Track Controls");
+  InputSetting("Track Length", &currentSettings->trackLength);
+  InputSetting("Train Head Position", &currentSettings->trainHeadX);
+  InputSetting("Train Length", &currentSettings->trainLength);
+  InputSetting("Switch Position", &currentSettings->switchPosition);
+  InputSetting("Track Multiplier", &currentSettings->trackMultiplier);
+  InputSetting("Frames Per Move", &currentSettings->framesPerMove);
+  InputSetting("Is Switch Flipped", &currentSettings->isSwitchFlipped);
+  InputSetting("Is Train Moving", &currentSettings->isTrainMoving);
 
   if (ImGui::Button("Reset")) {
     currentSettings->Reset();
   }
 }
 
-void RenderMainTrack(int initialXPos, int initialYPos,
-                     TrackSettings currentSettings) {
-  // Draw line for the track
-  ImDrawList *draw_list = ImGui::GetForegroundDrawList();
-  ImVec2 p1 = ImVec2(initialXPos, initialYPos);
-  ImVec2 p2 = ImVec2(initialXPos + currentSettings.switchPosition *
-                                       currentSettings.trackMultiplier,
-                     initialYPos);
-  draw_list->AddLine(p1, p2, currentSettings.mainTrackPart1Color, 8.0f);
-  p1 = ImVec2(initialXPos + currentSettings.switchPosition *
-                                currentSettings.trackMultiplier,
-              initialYPos);
-  p2 = ImVec2(initialXPos +
-                  currentSettings.trackLength * currentSettings.trackMultiplier,
-              initialYPos);
-  draw_list->AddLine(p1, p2, currentSettings.mainTrackPart2Color, 8.0f);
-}
-
-void RenderDivergentTrack(int initialXPos, int initialYPos,
-                          TrackSettings currentSettings) {
-  // Draw divergent track
-  ImDrawList *draw_list = ImGui::GetForegroundDrawList();
-  ImVec2 p1 = ImVec2(initialXPos + currentSettings.switchPosition *
-                                       currentSettings.trackMultiplier,
-                     initialYPos);
-  ImVec2 p2 = ImVec2(initialXPos +
-                         currentSettings.switchPosition *
-                             currentSettings.trackMultiplier +
-                         5 * currentSettings.trackMultiplier,
-                     initialYPos - 5 * currentSettings.trackMultiplier);
-  draw_list->AddLine(p1, p2, currentSettings.divergentTrackColor, 8.0f);
-  p1 = ImVec2(initialXPos +
-                  currentSettings.switchPosition *
-                      currentSettings.trackMultiplier +
-                  5 * currentSettings.trackMultiplier,
-
-              initialYPos - 5 * currentSettings.trackMultiplier);
-  p2 = ImVec2(initialXPos +
-                  currentSettings.trackLength * currentSettings.trackMultiplier,
-              initialYPos - 5 * currentSettings.trackMultiplier);
-  draw_list->AddLine(p1, p2, currentSettings.divergentTrackColor, 8.0f);
+bool loadLayout(LayoutImport *import, JobSystem *jobs) {
+  const char *path = import->path;
+  size_t length = strlen(path);
+  const char *extension = strrchr(path, '.');
+  extension = extension ? extension : path + length;
+  if (strcmp(extension, ".txt") == 0) {
+    LayoutTextError error;
+    if (!ImportLayoutText(path, &import->network, jobs, &error)) {
+      snprintf(import->error, sizeof(import->error), "%s:%lld: %s", path,
+               error.line, error.message);
+      return false;
+    }
+  } else if (strcmp(extension, ".railml") == 0 ||
+             strcmp(extension, ".xml") == 0) {
+    RailmlError error;
+    if (!ImportRailml(path, &import->network, &error)) {
+      snprintf(import->error, sizeof(import->error), "%s:%lld: %s", path,
+               error.line, error.message);
+      return false;
+    }
+  } else if (!LoadLayout(path, &import->network)) {
+    snprintf(import->error, sizeof(import->error), "%s: not a layout file",
+             path);
+    return false;
+  }
+  import->error[0] = 0;
+  return true;
+}
+
+void RenderLayoutImport(LayoutImport *import, JobSystem *jobs) {
+  // Show a layout file instead of the demo network, or go back to the demo
+  ImGui::SetNextItemWidth(200);
+  ImGui::InputText("Layout File", import->path, sizeof(import->path));
+  ImGui::SameLine();
+  if (ImGui::Button("Load Layout") && loadLayout(import, jobs)) {
+    import->isImported.value = true;
+    import->isImported.Touch();
+  }
+  if (import->isImported) {
+    ImGui::SameLine();
+    if (ImGui::Button("Use Demo Track")) {
+      import->isImported = false;
+    }
+    const TrackNetwork &network = import->network;
+    ImGui::Text("%d segments, %d switches, %d signals",
+                network.SegmentCount(), network.SwitchCount(),
+                network.SignalCount());
+  }
+  if (import->error[0]) {
+    ImGui::Text("%s", import->error);
+  }
+}
+
+void RenderWhatIf(WhatIfBranch *branch, const TrackLayout &layout,
+                  const TrainMotion &motion) {
+  if (!layout.isDemo) {
+    return;
+  }
+  // Run the train on from here with the switch the other way, leaving the
+  // live train and switch alone
+  const float framesPerSecond = 60.0f;
+  const int secondsAhead = 60;
+  if (ImGui::Button("What If Switch Thrown")) {
+    branch->Fork(layout.network, motion.simulation);
+    TrackNetwork &network = branch->Network();
+    network.switchReversed.Set(0, !network.switchReversed[0]);
+    branch->Run(secondsAhead * (int)framesPerSecond, 1.0f / framesPerSecond);
+  }
+  if (!branch->IsForked()) {
+    return;
+  }
+  ImGui::SameLine();
+  if (!branch->IsDone()) {
+    ImGui::Text("Running ahead: %.1f s", branch->TicksRun() / framesPerSecond);
+    return;
+  }
+  const TrainFleet &fleet = branch->Result().fleet;
+  if (fleet.Count() > 0) {
+    ImGui::Text("After %.1f s the head is at %.1f, %.1f%s",
+                branch->TicksRun() / framesPerSecond, fleet.x[0], fleet.y[0],
+                branch->ReachedEndTick() >= 0 ? " at the end of track" : "");
+  }
+  if (ImGui::Button("Discard What If")) {
+    branch->Discard();
+  }
+}
+
+// Names a supervised train for the operator, timetabled ones by their trip
+const char *SupervisedTrainName(int train, const ScheduledTrains &scheduled,
+                                char *name, size_t size) {
+  if (train == 0) {
+    return "the demo train";
+  }
+  const std::vector<int> &slotTrip = scheduled.service.slotTrip;
+  int slot = train - 1;
+  if (slot < (int)slotTrip.size() &&
+      slotTrip[slot] < scheduled.timetable.TripCount()) {
+    snprintf(name, size, "trip %s",
+             scheduled.timetable.tripId[slotTrip[slot]].c_str());
+  } else {
+    snprintf(name, size, "timetabled train %d", slot);
+  }
+  return name;
+}
+
+void RenderSupervision(const TrainSupervision &supervision,
+                       const ScheduledTrains &scheduled) {
+  // Trains closer than the minimum headway, or overlapping, right now
+  char rear[64], front[64];
+  for (const HeadwayConflict &conflict : supervision.conflicts) {
+    ImGui::TextColored(
+        ImGui::ColorConvertU32ToFloat4(conflict.gap < 0.0f ? RED : ORANGE),
+        "%s on segment %d: %s behind %s",
+        conflict.gap < 0.0f ? "Collision" : "Headway lost", conflict.segment,
+        SupervisedTrainName(conflict.rearTrain, scheduled, rear, sizeof(rear)),
+        SupervisedTrainName(conflict.frontTrain, scheduled, front,
+                            sizeof(front)));
+  }
+
+  // Conflicts predicted within the look-ahead, in simulated seconds
+  for (const ConflictWarning &warning : supervision.warnings) {
+    double seconds = warning.conflictTime - supervision.clock;
+    ImGui::TextColored(
+        ImGui::ColorConvertU32ToFloat4(ORANGE),
+        "Headway lost in %.0f s: %s behind %s",
+        seconds > 0.0 ? seconds : 0.0,
+        SupervisedTrainName(warning.rearTrain, scheduled, rear, sizeof(rear)),
+        SupervisedTrainName(warning.frontTrain, scheduled, front,
+                            sizeof(front)));
+  }
+}
+
+void RenderTimetable(ScheduledTrains *scheduled, const TrackLayout &layout) {
+  // Load a feed for the current layout and run it from the time of day
+  ImGui::SetNextItemWidth(200);
+  ImGui::InputText("Timetable Feed", scheduled->directory,
+                   sizeof(scheduled->directory));
+  ImGui::SameLine();
+  if (ImGui::Button("Load Timetable")) {
+    scheduled->isRunning =
+        LoadTimetable(scheduled->directory, layout.network,
+                      &scheduled->timetable, &scheduled->error);
+    if (scheduled->isRunning) {
+      time_t now = time(nullptr);
+      struct tm local;
+      localtime_r(&now, &local);
+      scheduled->service.Start(
+          DayNumber(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday),
+          (local.tm_hour * 60 + local.tm_min) * 60 + local.tm_sec);
+      Simulation &simulation = scheduled->simulation;
+      if (simulation.stock.empty()) {
+        simulation.stock.push_back(BuildStockTables(demoStock()));
+      }
+      simulation.Reset(layout.network);
+      scheduled->version = layout.version;
+    }
+  }
+  const TimetableError &error = scheduled->error;
+  if (error.message[0]) {
+    ImGui::Text("%s:%lld: %s", error.file, error.line, error.message);
+  }
+  if (!scheduled->isRunning) {
+    return;
+  }
+
+  const TimetableService &service = scheduled->service;
+  int seconds = (int)service.clock;
+  ImGui::Text("Day %d %02d:%02d:%02d: %d trips, %d running, %d waiting, "
+              "%d finished",
+              seconds / secondsPerDay + 1, seconds / 3600 % 24,
+              seconds / 60 % 60, seconds % 60,
+              scheduled->timetable.TripCount(),
+              scheduled->simulation.fleet.Count(), (int)service.waiting.size(),
+              service.finished);
+  ImGui::SetNextItemWidth(100);
+  ImGui::SliderInt("Timetable Speed-Up", &scheduled->speedUp, 1, 60);
+}
+
+void RenderMemory(const TrackLayout &layout, const TrainMotion &motion,
+                  const ScheduledTrains &scheduled) {
+  // Heap held by each subsystem, for watching the footprint of long runs
+  static const char *names[MemorySubsystem_COUNT] = {"ImGui", "Track geometry",
+                                                     "Simulation"};
+  MemoryUsage usage[MemorySubsystem_COUNT];
+  usage[MemorySubsystem_ImGui].bytes = imguiPool.LiveBytes();
+  usage[MemorySubsystem_ImGui].blocks = imguiPool.LiveBlocks();
+  layout.network.AddMemoryUsage(&usage[MemorySubsystem_TrackGeometry]);
+  motion.simulation.AddMemoryUsage(&usage[MemorySubsystem_Simulation]);
+  scheduled.simulation.AddMemoryUsage(&usage[MemorySubsystem_Simulation]);
+
+  ImGui::Begin("Memory");
+  for (int i = 0; i < MemorySubsystem_COUNT; i++) {
+    ImGui::Text("%-15s %10.1f KB in %zu blocks", names[i],
+                usage[i].bytes / 1024.0, usage[i].blocks);
+  }
+  ImGui::Separator();
+  ImGui::Text("ImGui pool holds %.1f KB after %llu allocations",
+              imguiPool.ReservedBytes() / 1024.0, imguiPool.Allocations());
+  ImGui::End();
+}
+
+void TextPercentiles(const char *label, const LatencyHistogram &latencies) {
+  ImGui::Text("%-6s %8.2f %8.2f %8.2f %8.2f", label,
+              latencies.Percentile(0.5) / 1000.0,
+              latencies.Percentile(0.99) / 1000.0,
+              latencies.Percentile(0.999) / 1000.0, latencies.Max() / 1000.0);
+}
+
+void RenderPerformance(PerformanceStats *performance, ImVec2 position) {
+  // Latency percentiles since the last reset, in milliseconds, and the last
+  // few seconds of frames, for watching stutter without a profiler
+  const int plotLength = PerformanceStats::plotLength;
+  int latest = (performance->plotNext + plotLength - 1) % plotLength;
+  ImGui::SetNextWindowPos(position, ImGuiCond_FirstUseEver);
+  ImGui::Begin("Performance");
+  ImGui::Text("Frame %.2f ms, tick %.2f ms",
+              performance->frameMilliseconds[latest],
+              performance->tickMilliseconds[latest]);
+  ImGui::Text("%d draw calls, %d vertices", performance->drawCalls,
+              performance->vertices);
+  ImGui::Separator();
+  ImGui::Text("%-6s %8s %8s %8s %8s", "ms", "p50", "p99", "p99.9", "max");
+  TextPercentiles("Frame", performance->frames);
+  TextPercentiles("Tick", performance->ticks);
+  ImGui::Text("Over %llu frames",
+              (unsigned long long)performance->frames.Count());
+  ImGui::SameLine();
+  if (ImGui::Button("Reset Percentiles")) {
+    performance->frames.Clear();
+    performance->ticks.Clear();
+  }
+  ImGui::PlotLines("Frame ms", performance->frameMilliseconds, plotLength,
+                   performance->plotNext, nullptr, 0.0f, 50.0f,
+                   ImVec2(0, 60));
+  ImGui::PlotLines("Tick ms", performance->tickMilliseconds, plotLength,
+                   performance->plotNext, nullptr, FLT_MAX, FLT_MAX,
+                   ImVec2(0, 60));
+  ImGui::End();
+}
+
+#ifdef RAILWAY_TRACE
+void RenderTrace() {
+  // Write out what the trace rings hold, for chrome://tracing or Perfetto
+  static const char *status = "";
+  if (ImGui::Button("Save Trace")) {
+    status = SaveTrace("trace.json") ? "Saved trace.json"
+                                     : "Cannot write trace.json";
+  }
+  ImGui::SameLine();
+  ImGui::Text("%s", status);
+}
+#endif
+
+void RenderTrack(const TrackLayout &layout, const TrackColors &colors,
+                 DrawBatches *batches, int firstBatch, int regionCount,
+                 JobSystem *jobs) {
+  TRACE_SCOPE("RenderTrack");
+  // Draw each region of track segments, and a share of the signals, into
+  // its own batch on the workers
+  const TrackNetwork &network = layout.network;
+  int regionSize = (network.SegmentCount() + regionCount - 1) / regionCount;
+  int signalShare = (network.SignalCount() + regionCount - 1) / regionCount;
+  jobs->ParallelFor(0, regionCount, 1, [&](int begin, int end) {
+    for (int region = begin; region < end; region++) {
+      TRACE_SCOPE("RenderTrack region");
+      ImDrawList *draw_list = batches->Batch(firstBatch + region);
+      int last = std::min((region + 1) * regionSize, network.SegmentCount());
+      for (int segment = region * regionSize; segment < last; segment++) {
+        draw_list->AddLine(layout.ToScreen(network.segmentStart[segment]),
+                           layout.ToScreen(network.segmentEnd[segment]),
+                           colors.segments.Color(segment), 8.0f);
+      }
+      last = std::min((region + 1) * signalShare, network.SignalCount());
+      for (int signal = region * signalShare; signal < last; signal++) {
+        ImVec2 point = network.PointAt(network.signalSegment[signal],
+                                       network.signalOffset[signal]);
+        draw_list->AddCircleFilled(layout.ToScreen(point), 5.0f, WHITE);
+      }
+    }
+  });
 }
 
 void HandleTrainClick(TrackSettings *currentSettings, ImVec2 topLeft,
@@ -132,34 +888,31 @@ void HandleTrainClick(TrackSettings *currentSettings, ImVec2 topLeft,
   if (isTrainHeadHovered) {
     if (ImGui::IsMouseClicked(ImGuiMouseButton_Left)) {
       currentSettings->isTrainMoving = true;
-      updateColors(currentSettings);
     }
   }
 }
 
-void RenderTrain(int initialXPos, int initialYPos, float trainSymbolsOffsetY,
-                 TrackSettings *currentSettings) {
+void RenderTrain(const TrackLayout &layout, const PathHistory &path,
+                 float trainSymbolsOffsetY, TrackSettings *currentSettings,
+                 ImDrawList *draw_list) {
+  if (!layout.isDemo) {
+    return;
+  }
   // Draw square to represent train head
-  ImVec2 topLeft = ImVec2(initialXPos + currentSettings->trainHeadX *
-                                            currentSettings->trackMultiplier,
-                          initialYPos - trainSymbolsOffsetY +
-                              currentSettings->trainHeadY *
-                                  currentSettings->trackMultiplier);
+  ImVec2 trainHead =
+      layout.ToScreen(currentSettings->trainHeadX, currentSettings->trainHeadY);
+  ImVec2 topLeft = ImVec2(trainHead.x, trainHead.y - trainSymbolsOffsetY);
   float squareSize = 10.0f;
   ImVec2 bottomRight = ImVec2(topLeft.x + squareSize, topLeft.y + squareSize);
 
-  ImDrawList *draw_list = ImGui::GetForegroundDrawList();
   draw_list->AddRectFilled(topLeft, bottomRight, IM_COL32(255, 255, 255, 255));
 
-  // Draw other parts of train
+  // Draw other parts of train, one track unit apart along the head's path
   for (int i = 1; i < currentSettings->trainLength; i++) {
     float circle_radius = squareSize / 2;
-    ImVec2 center = ImVec2(
-        initialXPos +
-            currentSettings->trainHeadX * currentSettings->trackMultiplier -
-            i * currentSettings->trackMultiplier + circle_radius,
-        initialYPos - trainSymbolsOffsetY / 2 - circle_radius +
-            currentSettings->trainHeadY * currentSettings->trackMultiplier);
+    ImVec2 car = layout.ToScreen(path.PointBehind((float)i).point);
+    ImVec2 center = ImVec2(car.x + circle_radius,
+                           car.y - trainSymbolsOffsetY / 2 - circle_radius);
     draw_list->AddCircleFilled(center, circle_radius,
                                IM_COL32(255, 255, 255, 255));
   }
@@ -167,6 +920,20 @@ void RenderTrain(int initialXPos, int initialYPos, float trainSymbolsOffsetY,
   HandleTrainClick(currentSettings, topLeft, bottomRight);
 }
 
+void RenderScheduledTrains(const TrackLayout &layout,
+                           const Simulation &simulation,
+                           ImDrawList *draw_list) {
+  // Draw a small square at each scheduled train's head
+  const float halfSize = 4.0f;
+  const TrainFleet &fleet = simulation.fleet;
+  for (int train = 0; train < fleet.Count(); train++) {
+    ImVec2 head = layout.ToScreen(fleet.x[train], fleet.y[train]);
+    draw_list->AddRectFilled(ImVec2(head.x - halfSize, head.y - halfSize),
+                             ImVec2(head.x + halfSize, head.y + halfSize),
+                             ORANGE);
+  }
+}
+
 // Main code
 int main(int, char **) {
   glfwSetErrorCallback(glfw_error_callback);
@@ -186,8 +953,9 @@ int main(int, char **) {
   glfwMakeContextCurrent(window);
   glfwSwapInterval(1); // Enable vsync
 
-  // Setup Dear ImGui context
+  // Setup Dear ImGui context, allocating from the pool from the start
   IMGUI_CHECKVERSION();
+  ImGui::SetAllocatorFunctions(ImGuiAllocate, ImGuiFree, &imguiPool);
   ImGui::CreateContext();
   ImGuiIO &io = ImGui::GetIO();
   (void)io;
@@ -204,15 +972,26 @@ int main(int, char **) {
   ImGui_ImplGlfw_InitForOpenGL(window, true);
   ImGui_ImplOpenGL3_Init(glsl_version);
 
+  // Worker threads, leaving the main thread its own core
+  int workerCount = (int)std::thread::hardware_concurrency() - 1;
+  JobSystem jobs(workerCount > 0 ? workerCount : 0);
+  DrawBatches drawBatches;
+  PerformanceStats performance;
+
   // Our state
   bool show_demo_window = false;
   bool show_another_window = false;
   ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
   while (!glfwWindowShouldClose(window)) {
-    glfwPollEvents();
+    TRACE_SCOPE("Frame");
+    {
+      TRACE_SCOPE("Input");
+      glfwPollEvents();
+    }
     if (glfwGetWindowAttrib(window, GLFW_ICONIFIED) != 0) {
       ImGui_ImplGlfw_Sleep(10);
+      performance.frameEnd = 0.0; // Not a stutter
       continue;
     }
 
@@ -221,93 +1000,109 @@ int main(int, char **) {
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
 
+    double tickSeconds = 0.0;
     {
       static TrackSettings currentSettings;
-      static int frameCounter = 0;
+      static TrackLayout layout;
+      static Interlocking interlocking;
+      static TrackColors colors;
+      static TrainPath trainPath;
+      static TrainMotion motion;
+      static TrainSupervision supervision;
+      static WhatIfBranch whatIf;
+      static ScheduledTrains scheduled;
+      static LayoutImport import;
 
       RenderDialog(&currentSettings);
+      RenderLayoutImport(&import, &jobs);
 
-      int initialXPos = 50;
-      int initialYPos = 450;
+      ImVec2 origin = ImVec2(50, 450);
       float trainSymbolsOffsetY = 20.0f;
 
-      RenderMainTrack(initialXPos, initialYPos, currentSettings);
-      RenderDivergentTrack(initialXPos, initialYPos, currentSettings);
-      RenderTrain(initialXPos, initialYPos, trainSymbolsOffsetY,
-                  &currentSettings);
+      updateLayout(&layout, currentSettings, import, origin);
+      updateInterlocking(&interlocking, &layout, &currentSettings);
 
       // Move the train on the screen
-      if (currentSettings.isTrainMoving) {
-        frameCounter++;
-
-        if (frameCounter >= currentSettings.framesPerMove) {
-          frameCounter = 0;
-
-          ImVec2 p1 = ImVec2(initialXPos + currentSettings.switchPosition *
-                                               currentSettings.trackMultiplier,
-                             initialYPos);
-          ImVec2 p2 = ImVec2(initialXPos +
-                                 currentSettings.switchPosition *
-                                     currentSettings.trackMultiplier +
-                                 5 * currentSettings.trackMultiplier,
-                             initialYPos - 5 * currentSettings.trackMultiplier);
-
-          // If the train is on the sloped portion and the switch is flipped
-          if ((initialXPos +
-                       currentSettings.trainHeadX *
-                           currentSettings.trackMultiplier +
-                       trainSymbolsOffsetY <
-                   p1.x ||
-               initialXPos +
-                       currentSettings.trainHeadX *
-                           currentSettings.trackMultiplier +
-                       trainSymbolsOffsetY >=
-                   p2.x) ||
-              !currentSettings.isSwitchFlipped) {
-            currentSettings.trainHeadX += 1;
-
-          } else {
-            // Calculate the slope between p1 and p2
-            float deltaX = p2.x - p1.x;
-            float deltaY = p2.y - p1.y;
-
-            // Move the train along this slope after it reaches the switch
-            currentSettings.trainHeadX +=
-                (deltaX / ((currentSettings.trackLength -
-                            currentSettings.switchPosition) *
-                           currentSettings.trackMultiplier)) *
-                2;
-            currentSettings.trainHeadY +=
-                (deltaY / ((currentSettings.trackLength -
-                            currentSettings.switchPosition) *
-                           currentSettings.trackMultiplier)) *
-                2;
-          }
-
-          // Reset position if it goes off the track
-          if (currentSettings.trainHeadX >= currentSettings.trackLength) {
-            currentSettings.isTrainMoving = false;
-            currentSettings.mainTrackPart1Color = RED;
-            currentSettings.mainTrackPart2Color = RED;
-            currentSettings.divergentTrackColor = RED;
-          }
-        }
+      double tickStart = glfwGetTime();
+      {
+        TRACE_SCOPE("Simulation");
+        updateTrainMotion(&motion, &trainPath, layout, interlocking,
+                          supervision, &currentSettings, &jobs);
+      }
+      tickSeconds = glfwGetTime() - tickStart;
+      RenderWhatIf(&whatIf, layout, motion);
+      tickStart = glfwGetTime();
+      {
+        TRACE_SCOPE("Scheduled trains");
+        updateScheduledTrains(&scheduled, layout, &jobs);
+      }
+      {
+        TRACE_SCOPE("Supervision");
+        updateSupervision(&supervision, layout, trainPath, motion.simulation,
+                          scheduled);
+      }
+      tickSeconds += glfwGetTime() - tickStart;
+      RenderSupervision(supervision, scheduled);
+      RenderTimetable(&scheduled, layout);
+#ifdef RAILWAY_TRACE
+      RenderTrace();
+#endif
+      updateColors(&colors, layout, interlocking,
+                   motion.simulation.occupancy, scheduled.simulation.occupancy,
+                   currentSettings);
+
+      // One batch per track region, sized so every thread has work once
+      // the network is large, and one batch for the train
+      const int segmentsPerRegion = 4096;
+      int regionCount = std::min(
+          jobs.ThreadCount(),
+          layout.network.SegmentCount() / segmentsPerRegion + 1);
+      drawBatches.Begin(regionCount + 1);
+      RenderTrack(layout, colors, &drawBatches, 0, regionCount, &jobs);
+      {
+        TRACE_SCOPE("RenderTrains");
+        RenderTrain(layout, trainPath.history, trainSymbolsOffsetY,
+                    &currentSettings, drawBatches.Batch(regionCount));
+        RenderScheduledTrains(layout, scheduled.simulation,
+                              drawBatches.Batch(regionCount));
       }
 
+      // Open the performance panel beside these controls
+      ImVec2 beside = ImGui::GetWindowPos();
+      beside.x += ImGui::GetWindowWidth() + 10.0f;
       ImGui::End();
+
+      RenderPerformance(&performance, beside);
+      RenderMemory(layout, motion, scheduled);
     }
 
     // Rendering
-    ImGui::Render();
+    {
+      TRACE_SCOPE("ImGui::Render");
+      ImGui::Render();
+    }
+    drawBatches.MergeInto(ImGui::GetDrawData());
+    performance.CountDrawData(ImGui::GetDrawData());
     int display_w, display_h;
     glfwGetFramebufferSize(window, &display_w, &display_h);
     glViewport(0, 0, display_w, display_h);
     glClearColor(clear_color.x * clear_color.w, clear_color.y * clear_color.w,
                  clear_color.z * clear_color.w, clear_color.w);
     glClear(GL_COLOR_BUFFER_BIT);
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    {
+      TRACE_SCOPE("RenderDrawData");
+      ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    }
 
-    glfwSwapBuffers(window);
+    {
+      TRACE_SCOPE("glfwSwapBuffers");
+      glfwSwapBuffers(window);
+    }
+    double frameEnd = glfwGetTime();
+    if (performance.frameEnd > 0.0) {
+      performance.Record(frameEnd - performance.frameEnd, tickSeconds);
+    }
+    performance.frameEnd = frameEnd;
   }
 
   // Cleanup
@@ -0,0 +1,42 @@
+#include "Arena.h"
+#include <algorithm>
+#include <stdint.h>
+
+static const size_t minimumBlockSize = 64 * 1024;
+
+void *Arena::Allocate(size_t size, size_t alignment) {
+  if (!blocks.empty()) {
+    uintptr_t base = (uintptr_t)blocks.back().data();
+    size_t start = ((base + used + alignment - 1) & ~(alignment - 1)) - base;
+    if (start + size <= blocks.back().size()) {
+      used = start + size;
+      return blocks.back().data() + start;
+    }
+  }
+
+  // Each new block at least doubles what the arena holds
+  size_t blockSize =
+      std::max(size + alignment, std::max(Capacity(), minimumBlockSize));
+  blocks.push_back(std::vector<char>(blockSize));
+  uintptr_t base = (uintptr_t)blocks.back().data();
+  size_t start = ((base + alignment - 1) & ~(alignment - 1)) - base;
+  used = start + size;
+  return blocks.back().data() + start;
+}
+
+void Arena::Reset() {
+  used = 0;
+  if (blocks.size() > 1) {
+    size_t capacity = Capacity();
+    blocks.clear();
+    blocks.push_back(std::vector<char>(capacity));
+  }
+}
+
+size_t Arena::Capacity() const {
+  size_t capacity = 0;
+  for (const std::vector<char> &block : blocks) {
+    capacity += block.size();
+  }
+  return capacity;
+}
@@ -0,0 +1,31 @@
+#include "DrawBatches.h"
+
+// Workers see no context, so ImGui's allocation hooks skip its debug
+// counters for the allocations they make
+thread_local ImGuiContext *ImGuiThreadContext = nullptr;
+
+void DrawBatches::Begin(int batchCount) {
+  while ((int)batches.size() < batchCount) {
+    batches.push_back(std::unique_ptr<DrawBatch>(new DrawBatch()));
+  }
+  activeCount = batchCount;
+
+  // Set up the lists the way ImGui sets up its foreground list
+  const ImDrawListSharedData &shared = *ImGui::GetDrawListSharedData();
+  ImGuiViewport *viewport = ImGui::GetMainViewport();
+  ImVec2 viewportEnd = ImVec2(viewport->Pos.x + viewport->Size.x,
+                              viewport->Pos.y + viewport->Size.y);
+  for (int i = 0; i < batchCount; i++) {
+    DrawBatch &batch = *batches[i];
+    batch.data = shared;
+    batch.list._ResetForNewFrame();
+    batch.list.PushTextureID(ImGui::GetIO().Fonts->TexID);
+    batch.list.PushClipRect(viewport->Pos, viewportEnd, false);
+  }
+}
+
+void DrawBatches::MergeInto(ImDrawData *drawData) {
+  for (int i = 0; i < activeCount; i++) {
+    drawData->AddDrawList(&batches[i]->list);
+  }
+}
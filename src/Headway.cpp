@@ -0,0 +1,127 @@
+#include "Headway.h"
+
+void HeadwayMonitor::Resize(int segmentCount) {
+  segmentIntervals.assign(segmentCount, std::vector<TrainInterval>());
+  activeSegments.clear();
+  isActive.assign(segmentCount, 0);
+}
+
+void HeadwayMonitor::Update(int segment, int train, float rear, float front) {
+  std::vector<TrainInterval> &intervals = segmentIntervals[segment];
+  for (TrainInterval &interval : intervals) {
+    if (interval.train == train) {
+      interval.rear = rear;
+      interval.front = front;
+      interval.tick = tick;
+      return;
+    }
+  }
+
+  TrainInterval interval;
+  interval.train = train;
+  interval.rear = rear;
+  interval.front = front;
+  interval.tick = tick;
+  intervals.push_back(interval);
+  orderChanges++;
+  if (!isActive[segment]) {
+    isActive[segment] = 1;
+    activeSegments.push_back(segment);
+  }
+}
+
+void HeadwayMonitor::UpdateTrain(const TrackNetwork &network,
+                                 const Occupancy &occupancy, int train,
+                                 int id, float tailOffset, float headOffset) {
+  int tail = occupancy.TailNode(train);
+  for (int node = tail; node >= 0; node = occupancy.NextTowardHead(node)) {
+    int segment = occupancy.SegmentOf(node);
+    bool isHead = occupancy.NextTowardHead(node) < 0;
+    Update(segment, id, node == tail ? tailOffset : 0.0f,
+           isHead ? headOffset : network.segmentLength[segment]);
+  }
+}
+
+void HeadwayMonitor::Detect(const TrackNetwork &network,
+                            std::vector<HeadwayConflict> *conflicts) {
+  conflicts->clear();
+
+  // Drop stale intervals and restore rear order, keeping the previous
+  // order as the starting point
+  for (size_t a = 0; a < activeSegments.size();) {
+    int segment = activeSegments[a];
+    std::vector<TrainInterval> &intervals = segmentIntervals[segment];
+    size_t kept = 0;
+    for (size_t i = 0; i < intervals.size(); i++) {
+      if (intervals[i].tick == tick) {
+        intervals[kept++] = intervals[i];
+      }
+    }
+    if (kept != intervals.size()) {
+      intervals.resize(kept);
+      orderChanges++;
+    }
+
+    for (size_t i = 1; i < intervals.size(); i++) {
+      TrainInterval moving = intervals[i];
+      size_t j = i;
+      for (; j > 0 && intervals[j - 1].rear > moving.rear; j--) {
+        intervals[j] = intervals[j - 1];
+      }
+      if (j != i) {
+        intervals[j] = moving;
+        orderChanges++;
+      }
+    }
+
+    if (intervals.empty()) {
+      isActive[segment] = 0;
+      activeSegments[a] = activeSegments.back();
+      activeSegments.pop_back();
+    } else {
+      a++;
+    }
+  }
+
+  for (int segment : activeSegments) {
+    const std::vector<TrainInterval> &intervals = segmentIntervals[segment];
+    HeadwayConflict conflict;
+    conflict.segment = segment;
+
+    // Furthest front seen so far and the train it belongs to
+    float reach = intervals[0].front;
+    int reachTrain = intervals[0].train;
+    for (size_t i = 1; i < intervals.size(); i++) {
+      float gap = intervals[i].rear - reach;
+      if (gap < minimumHeadway) {
+        conflict.rearTrain = reachTrain;
+        conflict.frontTrain = intervals[i].train;
+        conflict.gap = gap;
+        conflicts->push_back(conflict);
+      }
+      if (intervals[i].front > reach) {
+        reach = intervals[i].front;
+        reachTrain = intervals[i].train;
+      }
+    }
+
+    // Headway carries over onto the segment the leading train runs into
+    int next = network.NextSegment(segment);
+    if (next < 0 || segmentIntervals[next].empty()) {
+      continue;
+    }
+    const TrainInterval &ahead = segmentIntervals[next][0];
+    if (ahead.train == reachTrain) {
+      continue;
+    }
+    float gap = network.segmentLength[segment] - reach + ahead.rear;
+    if (gap < minimumHeadway) {
+      conflict.rearTrain = reachTrain;
+      conflict.frontTrain = ahead.train;
+      conflict.gap = gap;
+      conflicts->push_back(conflict);
+    }
+  }
+
+  tick++;
+}
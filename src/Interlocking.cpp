@@ -0,0 +1,143 @@
+#include "Interlocking.h"
+
+void Interlocking::Build(const TrackNetwork &network,
+                         const std::vector<Route> &builtRoutes) {
+  routes = builtRoutes;
+  routeCount = (int)builtRoutes.size();
+  for (int s = 0; s < network.SwitchCount(); s++) {
+    Route throwRoute;
+    throwRoute.switches.push_back(s);
+    throwRoute.switchReversed.push_back(0);
+    routes.push_back(throwRoute);
+  }
+  int totalRoutes = (int)routes.size();
+
+  // Routes using each segment and each switch
+  std::vector<std::vector<int>> segmentUsers(network.SegmentCount());
+  std::vector<std::vector<int>> switchUsers(network.SwitchCount());
+  routeSegments.assign(totalRoutes, BitSet());
+  for (int r = 0; r < totalRoutes; r++) {
+    routeSegments[r].Resize(network.SegmentCount());
+    for (int segment : routes[r].segments) {
+      routeSegments[r].Set(segment);
+      segmentUsers[segment].push_back(r);
+    }
+    for (int switchIndex : routes[r].switches) {
+      switchUsers[switchIndex].push_back(r);
+    }
+  }
+
+  conflicts.assign(totalRoutes, BitSet());
+  for (BitSet &row : conflicts) {
+    row.Resize(totalRoutes);
+  }
+  std::vector<std::vector<int>> *userLists[] = {&segmentUsers, &switchUsers};
+  for (std::vector<std::vector<int>> *userList : userLists) {
+    for (const std::vector<int> &users : *userList) {
+      for (int a : users) {
+        for (int b : users) {
+          if (a != b) {
+            conflicts[a].Set(b);
+          }
+        }
+      }
+    }
+  }
+
+  conflictWordBegin.assign(1, 0);
+  conflictWords.clear();
+  for (int r = 0; r < totalRoutes; r++) {
+    for (int w = 0; w < conflicts[r].WordCount(); w++) {
+      if (conflicts[r].words[w]) {
+        conflictWords.push_back(w);
+      }
+    }
+    conflictWordBegin.push_back((int)conflictWords.size());
+  }
+
+  setRouteWordCount = (totalRoutes + 63) / 64;
+  setRoutes.reset(new std::atomic<uint64_t>[setRouteWordCount]);
+  for (int w = 0; w < setRouteWordCount; w++) {
+    setRoutes[w].store(0);
+  }
+  changeCount++;
+}
+
+bool Interlocking::Claim(int route) {
+  const BitSet &row = conflicts[route];
+  int begin = conflictWordBegin[route];
+  int end = conflictWordBegin[route + 1];
+
+  // Cheap rejection before touching the shared word
+  for (int i = begin; i < end; i++) {
+    int w = conflictWords[i];
+    if (setRoutes[w].load() & row.words[w]) {
+      return false;
+    }
+  }
+
+  uint64_t bit = (uint64_t)1 << (route & 63);
+  if (setRoutes[route >> 6].fetch_or(bit) & bit) {
+    return false;
+  }
+
+  // A conflicting route claimed at the same time is now visible; back off
+  for (int i = begin; i < end; i++) {
+    int w = conflictWords[i];
+    if (setRoutes[w].load() & row.words[w]) {
+      setRoutes[route >> 6].fetch_and(~bit);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Interlocking::RequestRoute(TrackNetwork *network, int route) {
+  if (!Claim(route)) {
+    return false;
+  }
+  // Holding the route excludes every other user of its switches
+  const Route &granted = routes[route];
+  for (size_t i = 0; i < granted.switches.size(); i++) {
+    network->switchReversed.Set(granted.switches[i], granted.switchReversed[i]);
+  }
+  changeCount++;
+  return true;
+}
+
+void Interlocking::ReleaseRoute(int route) {
+  uint64_t bit = (uint64_t)1 << (route & 63);
+  if (setRoutes[route >> 6].fetch_and(~bit) & bit) {
+    changeCount++;
+  }
+}
+
+bool Interlocking::IsRouteSet(int route) const {
+  return (setRoutes[route >> 6].load() >> (route & 63)) & 1;
+}
+
+bool Interlocking::ThrowSwitch(TrackNetwork *network, int switchIndex,
+                               bool reversed) {
+  int throwRoute = routeCount + switchIndex;
+  if (!Claim(throwRoute)) {
+    return false;
+  }
+  network->switchReversed.Set(switchIndex, reversed);
+  ReleaseRoute(throwRoute);
+  return true;
+}
+
+void Interlocking::ReservedSegments(BitSet *reserved) const {
+  reserved->ClearAll();
+  for (int w = 0; w < setRouteWordCount; w++) {
+    uint64_t word = setRoutes[w].load();
+    while (word) {
+      int route = w * 64 + LowestBit(word);
+      word &= word - 1;
+      const BitSet &segments = routeSegments[route];
+      for (int i = 0; i < segments.WordCount(); i++) {
+        reserved->words[i] |= segments.words[i];
+      }
+    }
+  }
+}
@@ -0,0 +1,128 @@
+#include "JobSystem.h"
+
+// Queue index of the current thread in the system it works for; the
+// calling thread uses queue 0
+static thread_local const JobSystem *currentSystem = nullptr;
+static thread_local int currentQueue = 0;
+
+JobSystem::JobSystem(int workerCount)
+    : queues(new WorkQueue[workerCount + 1]), queueCount(workerCount + 1),
+      queuedJobs(0), stopping(false) {
+  for (int i = 1; i <= workerCount; i++) {
+    threads.push_back(std::thread(&JobSystem::WorkerLoop, this, i));
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+int JobSystem::CallerQueue() const {
+  return currentSystem == this ? currentQueue : 0;
+}
+
+bool JobSystem::Push(int self, const Job &job) {
+  WorkQueue &queue = queues[self];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.count == WorkQueue::capacity) {
+      return false;
+    }
+    queue.jobs[(queue.front + queue.count) % WorkQueue::capacity] = job;
+    queue.count++;
+  }
+  queuedJobs++;
+  if (!threads.empty()) {
+    // Pass through the sleep lock so a worker between its check and its
+    // wait cannot miss the notification
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_one();
+  }
+  return true;
+}
+
+bool JobSystem::PopBack(int self, Job *job) {
+  WorkQueue &queue = queues[self];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.count == 0) {
+    return false;
+  }
+  queue.count--;
+  *job = queue.jobs[(queue.front + queue.count) % WorkQueue::capacity];
+  queuedJobs--;
+  return true;
+}
+
+bool JobSystem::StealFront(int victim, Job *job) {
+  WorkQueue &queue = queues[victim];
+  std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+  if (!lock.owns_lock() || queue.count == 0) {
+    return false;
+  }
+  *job = queue.jobs[queue.front];
+  queue.front = (queue.front + 1) % WorkQueue::capacity;
+  queue.count--;
+  queuedJobs--;
+  return true;
+}
+
+void JobSystem::Execute(int self, Job job) {
+  // Hand the upper half to thieves until the rest fits one chunk
+  while (job.end - job.begin > job.grain) {
+    Job upper = job;
+    upper.begin = job.begin + (job.end - job.begin) / 2;
+    job.pending->fetch_add(1);
+    if (!Push(self, upper)) {
+      job.pending->fetch_sub(1);
+      break;
+    }
+    job.end = upper.begin;
+  }
+  job.run(job.body, job.begin, job.end);
+  job.pending->fetch_sub(1);
+}
+
+bool JobSystem::RunOne(int self) {
+  Job job;
+  if (PopBack(self, &job)) {
+    Execute(self, job);
+    return true;
+  }
+  for (int i = 1; i < queueCount; i++) {
+    if (StealFront((self + i) % queueCount, &job)) {
+      Execute(self, job);
+      return true;
+    }
+  }
+  return false;
+}
+
+void JobSystem::Wait(std::atomic<int> &pending) {
+  int self = CallerQueue();
+  while (pending.load() > 0) {
+    if (!RunOne(self)) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void JobSystem::WorkerLoop(int self) {
+  currentSystem = this;
+  currentQueue = self;
+  while (!stopping) {
+    if (RunOne(self)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    wake.wait(lock, [this] { return stopping || queuedJobs.load() > 0; });
+  }
+}
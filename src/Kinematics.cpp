@@ -0,0 +1,120 @@
+#include "Kinematics.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) &&                              \
+    (defined(__x86_64__) || defined(__i386__))
+#define KINEMATICS_HAS_AVX2 1
+#include <immintrin.h>
+#endif
+
+// Kinematics for trains [begin, end), listing crossings after the `count`
+// already in crossed; returns the new count
+static int UpdateRange(TrainFleet *fleet, const TrackNetwork &network,
+                       float dt, int begin, int end, int *crossed, int count) {
+  const ImVec2 *start = network.segmentStart.data();
+  const ImVec2 *direction = network.segmentDirection.data();
+  const float *length = network.segmentLength.data();
+  const float halfDtSquared = 0.5f * dt * dt;
+
+  for (int i = begin; i < end; i++) {
+    int segment = fleet->segment[i];
+    float offset = fleet->offset[i] + fleet->speed[i] * dt -
+                   fleet->acceleration[i] * halfDtSquared;
+    fleet->offset[i] = offset;
+    fleet->x[i] = start[segment].x + direction[segment].x * offset;
+    fleet->y[i] = start[segment].y + direction[segment].y * offset;
+    if (offset >= length[segment]) {
+      crossed[count++] = i;
+    }
+  }
+  return count;
+}
+
+void UpdateKinematicsScalar(TrainFleet *fleet, const TrackNetwork &network,
+                            float dt, std::vector<int> *crossed) {
+  crossed->resize(fleet->Count());
+  crossed->resize(
+      UpdateRange(fleet, network, dt, 0, fleet->Count(), crossed->data(), 0));
+}
+
+#ifdef KINEMATICS_HAS_AVX2
+__attribute__((target("avx2,fma"))) static int
+UpdateKinematicsAvx2(TrainFleet *fleet, const TrackNetwork &network, float dt,
+                     int begin, int end, int *crossed) {
+  int count = 0;
+  const int *segments = fleet->segment.data();
+  const float *speed = fleet->speed.data();
+  const float *acceleration = fleet->acceleration.data();
+  float *offsets = fleet->offset.data();
+  float *xs = fleet->x.data();
+  float *ys = fleet->y.data();
+  // ImVec2 arrays are gathered as interleaved floats
+  const float *start = &network.segmentStart.data()->x;
+  const float *direction = &network.segmentDirection.data()->x;
+  const float *length = network.segmentLength.data();
+
+  const __m256 dtVector = _mm256_set1_ps(dt);
+  const __m256 halfDtSquared = _mm256_set1_ps(-0.5f * dt * dt);
+  const __m256i one = _mm256_set1_epi32(1);
+
+  int i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m256i segment = _mm256_loadu_si256((const __m256i *)(segments + i));
+    __m256i xIndex = _mm256_add_epi32(segment, segment);
+    __m256i yIndex = _mm256_add_epi32(xIndex, one);
+
+    __m256 offset = _mm256_loadu_ps(offsets + i);
+    offset = _mm256_fmadd_ps(_mm256_loadu_ps(speed + i), dtVector, offset);
+    offset = _mm256_fmadd_ps(_mm256_loadu_ps(acceleration + i),
+                             halfDtSquared, offset);
+    _mm256_storeu_ps(offsets + i, offset);
+
+    __m256 startX = _mm256_i32gather_ps(start, xIndex, 4);
+    __m256 startY = _mm256_i32gather_ps(start, yIndex, 4);
+    __m256 directionX = _mm256_i32gather_ps(direction, xIndex, 4);
+    __m256 directionY = _mm256_i32gather_ps(direction, yIndex, 4);
+    _mm256_storeu_ps(xs + i, _mm256_fmadd_ps(directionX, offset, startX));
+    _mm256_storeu_ps(ys + i, _mm256_fmadd_ps(directionY, offset, startY));
+
+    __m256 segmentLength = _mm256_i32gather_ps(length, segment, 4);
+    int ended =
+        _mm256_movemask_ps(_mm256_cmp_ps(offset, segmentLength, _CMP_GE_OQ));
+    while (ended) {
+      crossed[count++] = i + __builtin_ctz(ended);
+      ended &= ended - 1;
+    }
+  }
+  return UpdateRange(fleet, network, dt, i, end, crossed, count);
+}
+
+static bool HasAvx2() {
+  static const bool hasAvx2 =
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  return hasAvx2;
+}
+#endif
+
+void UpdateKinematics(TrainFleet *fleet, const TrackNetwork &network, float dt,
+                      std::vector<int> *crossed) {
+  crossed->resize(fleet->Count());
+  crossed->resize(UpdateKinematics(fleet, network, dt, 0, fleet->Count(),
+                                   crossed->data()));
+}
+
+int UpdateKinematics(TrainFleet *fleet, const TrackNetwork &network, float dt,
+                     int begin, int end, int *crossed) {
+#ifdef KINEMATICS_HAS_AVX2
+  if (HasAvx2()) {
+    return UpdateKinematicsAvx2(fleet, network, dt, begin, end, crossed);
+  }
+#endif
+  return UpdateRange(fleet, network, dt, begin, end, crossed, 0);
+}
+
+const char *KinematicsImplementation() {
+#ifdef KINEMATICS_HAS_AVX2
+  if (HasAvx2()) {
+    return "AVX2";
+  }
+#endif
+  return "Scalar";
+}
@@ -0,0 +1,188 @@
+#include "KineticHeadway.h"
+#include <math.h>
+
+void KineticHeadway::SetMotion(int train, float speed, float acceleration) {
+  if (train >= (int)trainSpeed.size()) {
+    trainSpeed.resize(train + 1, 0.0f);
+    trainAcceleration.resize(train + 1, 0.0f);
+    trainChanged.resize(train + 1, 0);
+  }
+  if (trainSpeed[train] == speed && trainAcceleration[train] == acceleration) {
+    return;
+  }
+  trainSpeed[train] = speed;
+  trainAcceleration[train] = acceleration;
+  trainChanged[train] = 1;
+  anyChanged = true;
+}
+
+// Earliest time from now at which gap + closing terms reach the headway,
+// or a negative value if it never does
+static double TimeToConflict(float gap, float headway, float relativeSpeed,
+                             float relativeAcceleration) {
+  double c = gap - headway;
+  if (c <= 0) {
+    return 0.0;
+  }
+  double a = 0.5 * relativeAcceleration;
+  double b = relativeSpeed;
+  if (fabs(a) < 1e-9) {
+    return b < 0 ? -c / b : -1.0;
+  }
+  double discriminant = b * b - 4 * a * c;
+  if (discriminant < 0) {
+    return -1.0;
+  }
+  double root = sqrt(discriminant);
+  double t1 = (-b - root) / (2 * a);
+  double t2 = (-b + root) / (2 * a);
+  if (t1 > t2) {
+    double swap = t1;
+    t1 = t2;
+    t2 = swap;
+  }
+  return t1 > 0 ? t1 : (t2 > 0 ? t2 : -1.0);
+}
+
+void KineticHeadway::Solve(Certificate *certificate, float gap, double now,
+                           EventQueue *queue) {
+  int rear = certificate->rearTrain;
+  int front = certificate->frontTrain;
+  float rearSpeed = rear < (int)trainSpeed.size() ? trainSpeed[rear] : 0;
+  float frontSpeed = front < (int)trainSpeed.size() ? trainSpeed[front] : 0;
+  float rearAcceleration =
+      rear < (int)trainAcceleration.size() ? trainAcceleration[rear] : 0;
+  float frontAcceleration =
+      front < (int)trainAcceleration.size() ? trainAcceleration[front] : 0;
+
+  certificate->generation++;
+  double t = TimeToConflict(gap, minimumHeadway, frontSpeed - rearSpeed,
+                            frontAcceleration - rearAcceleration);
+  if (t < 0) {
+    certificate->conflictTime = -1.0;
+    return;
+  }
+  certificate->conflictTime = now + t;
+
+  SimEvent event;
+  event.time = certificate->conflictTime - lookahead;
+  event.type = SimEvent_CertificateFailure;
+  event.subject = (int)(certificate - &certificates[0]);
+  event.generation = certificate->generation;
+  queue->Push(event);
+}
+
+void KineticHeadway::Certify(int rearTrain, int frontTrain, float gap,
+                             double now, EventQueue *queue) {
+  uint64_t key = (uint64_t)(uint32_t)rearTrain << 32 | (uint32_t)frontTrain;
+  std::unordered_map<uint64_t, int>::iterator found =
+      pairCertificate.find(key);
+  bool isNew = found == pairCertificate.end();
+  int index;
+  if (isNew) {
+    if (!freeCertificates.empty()) {
+      index = freeCertificates.back();
+      freeCertificates.pop_back();
+    } else {
+      index = (int)certificates.size();
+      certificates.push_back(Certificate());
+      certificates[index].generation = 0;
+    }
+    certificates[index].rearTrain = rearTrain;
+    certificates[index].frontTrain = frontTrain;
+    pairCertificate[key] = index;
+  } else {
+    index = found->second;
+  }
+  Certificate &certificate = certificates[index];
+  // A pair seen twice in one refresh, such as on either side of a segment
+  // end, is solved once
+  if (certificate.refresh == refreshCount) {
+    return;
+  }
+  certificate.refresh = refreshCount;
+
+  if (isNew || IsChanged(rearTrain) || IsChanged(frontTrain)) {
+    Solve(&certificate, gap, now, queue);
+  }
+}
+
+void KineticHeadway::Refresh(const TrackNetwork &network,
+                             const HeadwayMonitor &monitor, double now,
+                             EventQueue *queue) {
+  if (!anyChanged && monitor.OrderChanges() == lastOrderChanges) {
+    return;
+  }
+  lastOrderChanges = monitor.OrderChanges();
+  refreshCount++;
+
+  for (int segment : monitor.ActiveSegments()) {
+    const std::vector<TrainInterval> &intervals = monitor.Intervals(segment);
+    if (intervals.empty()) {
+      continue;
+    }
+    for (size_t i = 0; i + 1 < intervals.size(); i++) {
+      const TrainInterval &rear = intervals[i];
+      const TrainInterval &front = intervals[i + 1];
+      if (rear.train != front.train) {
+        Certify(rear.train, front.train, front.rear - rear.front, now, queue);
+      }
+    }
+
+    // The segment's lead train runs up behind the rearmost train on the
+    // segment it runs into, as in HeadwayMonitor::Detect
+    float reach = intervals[0].front;
+    int reachTrain = intervals[0].train;
+    for (const TrainInterval &interval : intervals) {
+      if (interval.front > reach) {
+        reach = interval.front;
+        reachTrain = interval.train;
+      }
+    }
+    int next = network.NextSegment(segment);
+    if (next < 0 || monitor.Intervals(next).empty()) {
+      continue;
+    }
+    const TrainInterval &ahead = monitor.Intervals(next)[0];
+    if (ahead.train != reachTrain) {
+      Certify(reachTrain, ahead.train,
+              network.segmentLength[segment] - reach + ahead.rear, now,
+              queue);
+    }
+  }
+
+  // Pairs that are no longer adjacent give up their certificates
+  std::unordered_map<uint64_t, int>::iterator it = pairCertificate.begin();
+  while (it != pairCertificate.end()) {
+    Certificate &certificate = certificates[it->second];
+    if (certificate.refresh != refreshCount) {
+      certificate.generation++;
+      freeCertificates.push_back(it->second);
+      it = pairCertificate.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  trainChanged.assign(trainChanged.size(), 0);
+  anyChanged = false;
+}
+
+void KineticHeadway::HandleEvent(
+    const SimEvent &event, std::vector<ConflictWarning> *warnings) const {
+  if (event.type != SimEvent_CertificateFailure ||
+      event.subject >= (int)certificates.size()) {
+    return;
+  }
+  const Certificate &certificate = certificates[event.subject];
+  if (certificate.generation != event.generation) {
+    return;
+  }
+  ConflictWarning warning;
+  warning.rearTrain = certificate.rearTrain;
+  warning.frontTrain = certificate.frontTrain;
+  warning.conflictTime = certificate.conflictTime;
+  warning.certificate = event.subject;
+  warning.generation = event.generation;
+  warnings->push_back(warning);
+}
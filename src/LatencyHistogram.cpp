@@ -0,0 +1,59 @@
+#include "LatencyHistogram.h"
+#include <math.h>
+#include <string.h>
+
+// 128 sub-buckets, the upper half of which each power of two from 128 up
+// reuses at its own width
+static const int subBucketBits = 7;
+static const int subBucketCount = 1 << subBucketBits;
+static const int halfCount = subBucketCount / 2;
+
+static int BucketOf(uint32_t value) {
+  if (value < (uint32_t)subBucketCount) {
+    return (int)value;
+  }
+  // Shifting the value down leaves it in [halfCount, subBucketCount)
+  int shift = 31 - __builtin_clz(value) - subBucketBits + 1;
+  return shift * halfCount + (int)(value >> shift);
+}
+
+// The highest value that lands in the bucket
+static uint32_t BucketTop(int bucket) {
+  if (bucket < subBucketCount) {
+    return (uint32_t)bucket;
+  }
+  int shift = bucket / halfCount - 1;
+  uint32_t bottom = (uint32_t)(bucket % halfCount + halfCount) << shift;
+  return bottom + ((1u << shift) - 1);
+}
+
+void LatencyHistogram::Record(uint32_t microseconds) {
+  counts[BucketOf(microseconds)]++;
+  count++;
+  if (microseconds > max) {
+    max = microseconds;
+  }
+}
+
+void LatencyHistogram::Clear() {
+  memset(counts, 0, sizeof(counts));
+  count = 0;
+  max = 0;
+}
+
+uint32_t LatencyHistogram::Percentile(double fraction) const {
+  if (count == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)ceil(fraction * count);
+  rank = rank < 1 ? 1 : rank > count ? count : rank;
+  uint64_t seen = 0;
+  for (int bucket = 0; bucket < bucketCount; bucket++) {
+    seen += counts[bucket];
+    if (seen >= rank) {
+      uint32_t top = BucketTop(bucket);
+      return top < max ? top : max;
+    }
+  }
+  return max;
+}
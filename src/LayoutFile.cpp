@@ -0,0 +1,188 @@
+#include "LayoutFile.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(ImVec2) == 2 * sizeof(float),
+              "layout files store ImVec2 as two floats");
+
+// The network's arrays in LayoutArray_ order
+struct LayoutArrays {
+  const void *items[LayoutArray_Count];
+  uint64_t itemSize[LayoutArray_Count];
+  uint64_t count[LayoutArray_Count];
+
+  template <typename T>
+  void Add(LayoutArray_ array, const SharedArray<T> &values) {
+    items[array] = values.data();
+    itemSize[array] = sizeof(T);
+    count[array] = values.size();
+  }
+};
+
+static LayoutArrays ArraysOf(const TrackNetwork &network) {
+  LayoutArrays arrays;
+  arrays.Add(LayoutArray_SegmentStart, network.segmentStart);
+  arrays.Add(LayoutArray_SegmentEnd, network.segmentEnd);
+  arrays.Add(LayoutArray_SegmentDirection, network.segmentDirection);
+  arrays.Add(LayoutArray_SegmentLength, network.segmentLength);
+  arrays.Add(LayoutArray_SegmentNext, network.segmentNext);
+  arrays.Add(LayoutArray_SegmentSwitch, network.segmentSwitch);
+  arrays.Add(LayoutArray_SwitchApproach, network.switchApproach);
+  arrays.Add(LayoutArray_SwitchNormal, network.switchNormal);
+  arrays.Add(LayoutArray_SwitchReverse, network.switchReverse);
+  arrays.Add(LayoutArray_SwitchReversed, network.switchReversed);
+  arrays.Add(LayoutArray_LegSegments, network.legSegments);
+  arrays.Add(LayoutArray_LegBegin, network.legBegin);
+  arrays.Add(LayoutArray_SignalSegment, network.signalSegment);
+  arrays.Add(LayoutArray_SignalOffset, network.signalOffset);
+  return arrays;
+}
+
+static uint64_t AlignUp(uint64_t offset) {
+  return (offset + layoutFileAlignment - 1) & ~(layoutFileAlignment - 1);
+}
+
+bool SaveLayout(const char *path, const TrackNetwork &network) {
+  LayoutArrays arrays = ArraysOf(network);
+  LayoutFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, layoutFileMagic, sizeof(header.magic));
+  header.version = layoutFileVersion;
+  header.byteOrder = layoutFileByteOrder;
+  header.arrayCount = LayoutArray_Count;
+
+  LayoutFileArray table[LayoutArray_Count];
+  uint64_t offset = sizeof(header) + sizeof(table);
+  for (int i = 0; i < LayoutArray_Count; i++) {
+    offset = AlignUp(offset);
+    table[i].offset = offset;
+    table[i].count = arrays.count[i];
+    offset += arrays.itemSize[i] * arrays.count[i];
+  }
+  header.fileSize = offset;
+
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(table, sizeof(table), 1, file) == 1;
+  static const char padding[layoutFileAlignment] = {};
+  offset = sizeof(header) + sizeof(table);
+  for (int i = 0; i < LayoutArray_Count && written; i++) {
+    size_t gap = (size_t)(table[i].offset - offset);
+    size_t bytes = (size_t)(arrays.itemSize[i] * arrays.count[i]);
+    written = (gap == 0 || fwrite(padding, gap, 1, file) == 1) &&
+              (bytes == 0 || fwrite(arrays.items[i], bytes, 1, file) == 1);
+    offset = table[i].offset + bytes;
+  }
+  return fclose(file) == 0 && written;
+}
+
+template <typename T>
+static bool ViewArray(const char *base, uint64_t fileSize,
+                      const LayoutFileArray &entry,
+                      const std::shared_ptr<const void> &mapping,
+                      SharedArray<T> *array) {
+  if (entry.offset % layoutFileAlignment != 0 || entry.offset > fileSize ||
+      entry.count > (fileSize - entry.offset) / sizeof(T)) {
+    return false;
+  }
+  *array = SharedArray<T>::View((const T *)(base + entry.offset),
+                                (size_t)entry.count, mapping);
+  return true;
+}
+
+bool LoadLayout(const char *path, TrackNetwork *network) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat status;
+  LayoutFileHeader header;
+  LayoutFileArray table[LayoutArray_Count];
+  uint64_t tableEnd = sizeof(header) + sizeof(table);
+  if (fstat(fd, &status) != 0 || (uint64_t)status.st_size < tableEnd) {
+    close(fd);
+    return false;
+  }
+  size_t size = (size_t)status.st_size;
+  void *base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+  std::shared_ptr<const void> mapping(
+      base, [size](const void *memory) { munmap((void *)memory, size); });
+
+  memcpy(&header, base, sizeof(header));
+  memcpy(table, (const char *)base + sizeof(header), sizeof(table));
+  if (memcmp(header.magic, layoutFileMagic, sizeof(header.magic)) != 0 ||
+      header.version != layoutFileVersion ||
+      header.byteOrder != layoutFileByteOrder ||
+      header.arrayCount != LayoutArray_Count || header.fileSize != size) {
+    return false;
+  }
+
+  // Arrays of one kind must agree on their count
+  uint64_t segments = table[LayoutArray_SegmentStart].count;
+  uint64_t switches = table[LayoutArray_SwitchApproach].count;
+  for (int i = LayoutArray_SegmentStart; i <= LayoutArray_SegmentSwitch; i++) {
+    if (table[i].count != segments) {
+      return false;
+    }
+  }
+  for (int i = LayoutArray_SwitchApproach; i <= LayoutArray_SwitchReversed;
+       i++) {
+    if (table[i].count != switches) {
+      return false;
+    }
+  }
+  if (segments > INT32_MAX ||
+      table[LayoutArray_LegBegin].count != 2 * switches + 1 ||
+      table[LayoutArray_SignalOffset].count !=
+          table[LayoutArray_SignalSegment].count) {
+    return false;
+  }
+
+  const char *bytes = (const char *)base;
+  TrackNetwork loaded;
+  bool viewed =
+      ViewArray(bytes, size, table[LayoutArray_SegmentStart], mapping,
+                &loaded.segmentStart) &&
+      ViewArray(bytes, size, table[LayoutArray_SegmentEnd], mapping,
+                &loaded.segmentEnd) &&
+      ViewArray(bytes, size, table[LayoutArray_SegmentDirection], mapping,
+                &loaded.segmentDirection) &&
+      ViewArray(bytes, size, table[LayoutArray_SegmentLength], mapping,
+                &loaded.segmentLength) &&
+      ViewArray(bytes, size, table[LayoutArray_SegmentNext], mapping,
+                &loaded.segmentNext) &&
+      ViewArray(bytes, size, table[LayoutArray_SegmentSwitch], mapping,
+                &loaded.segmentSwitch) &&
+      ViewArray(bytes, size, table[LayoutArray_SwitchApproach], mapping,
+                &loaded.switchApproach) &&
+      ViewArray(bytes, size, table[LayoutArray_SwitchNormal], mapping,
+                &loaded.switchNormal) &&
+      ViewArray(bytes, size, table[LayoutArray_SwitchReverse], mapping,
+                &loaded.switchReverse) &&
+      ViewArray(bytes, size, table[LayoutArray_SwitchReversed], mapping,
+                &loaded.switchReversed) &&
+      ViewArray(bytes, size, table[LayoutArray_LegSegments], mapping,
+                &loaded.legSegments) &&
+      ViewArray(bytes, size, table[LayoutArray_LegBegin], mapping,
+                &loaded.legBegin) &&
+      ViewArray(bytes, size, table[LayoutArray_SignalSegment], mapping,
+                &loaded.signalSegment) &&
+      ViewArray(bytes, size, table[LayoutArray_SignalOffset], mapping,
+                &loaded.signalOffset);
+  if (!viewed || (uint64_t)loaded.legBegin.back() > loaded.legSegments.size()) {
+    return false;
+  }
+  *network = loaded;
+  return true;
+}
@@ -0,0 +1,394 @@
+#include "LayoutText.h"
+#include <algorithm>
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// Read this much of the file at a time
+static const size_t blockSize = 8 << 20;
+// Chunks smaller than this are not worth a job
+static const size_t minChunkSize = 64 << 10;
+
+struct SegmentRecord {
+  int id;
+  ImVec2 start;
+  ImVec2 end;
+  long long line;
+};
+
+// A connect, switch or signal; unused fields stay zero
+struct LinkRecord {
+  int a;
+  int b;
+  int c;
+  float offset;
+  long long line;
+};
+
+// Everything one chunk of the file held, with lines counted from the start
+// of the chunk until merged
+struct ParsedRecords {
+  std::vector<SegmentRecord> segments;
+  std::vector<LinkRecord> connects;
+  std::vector<LinkRecord> switches;
+  std::vector<LinkRecord> signals;
+  long long lineCount = 0;
+  LayoutTextError error;
+
+  void Clear() {
+    segments.clear();
+    connects.clear();
+    switches.clear();
+    signals.clear();
+    lineCount = 0;
+    error = LayoutTextError();
+  }
+};
+
+static void Fail(LayoutTextError *error, long long line, const char *format,
+                 ...) {
+  error->line = line;
+  va_list args;
+  va_start(args, format);
+  vsnprintf(error->message, sizeof(error->message), format, args);
+  va_end(args);
+}
+
+static void SkipSpaces(const char **p, const char *end) {
+  while (*p < end && (**p == ' ' || **p == '\t' || **p == '\r')) {
+    (*p)++;
+  }
+}
+
+static bool ParseInt(const char **p, const char *end, int *value) {
+  SkipSpaces(p, end);
+  const char *s = *p;
+  bool negative = s < end && *s == '-';
+  s += negative || (s < end && *s == '+');
+  const char *digits = s;
+  int64_t result = 0;
+  while (s < end && *s >= '0' && *s <= '9' && result <= INT32_MAX) {
+    result = result * 10 + (*s++ - '0');
+  }
+  if (s == digits || result > INT32_MAX) {
+    return false;
+  }
+  *value = (int)(negative ? -result : result);
+  *p = s;
+  return true;
+}
+
+static bool ParseFloat(const char **p, const char *end, float *value) {
+  // Decimal with an optional exponent; the first 19 significant digits
+  // count, which is more than a float holds
+  static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22};
+  SkipSpaces(p, end);
+  const char *s = *p;
+  bool negative = s < end && *s == '-';
+  s += negative || (s < end && *s == '+');
+  uint64_t mantissa = 0;
+  int digitCount = 0;
+  int exponent = 0;
+  bool any = false;
+  for (; s < end && *s >= '0' && *s <= '9'; s++, any = true) {
+    if (digitCount < 19) {
+      mantissa = mantissa * 10 + (*s - '0');
+      digitCount += mantissa != 0;
+    } else {
+      exponent++;
+    }
+  }
+  if (s < end && *s == '.') {
+    for (s++; s < end && *s >= '0' && *s <= '9'; s++, any = true) {
+      if (digitCount < 19) {
+        mantissa = mantissa * 10 + (*s - '0');
+        digitCount += mantissa != 0;
+        exponent--;
+      }
+    }
+  }
+  if (!any) {
+    return false;
+  }
+  if (s < end && (*s == 'e' || *s == 'E')) {
+    s++;
+    int written = 0;
+    if (!ParseInt(&s, end, &written) || written < -400 || written > 400) {
+      return false;
+    }
+    exponent += written;
+  }
+  double result = (double)mantissa;
+  if (exponent != 0) {
+    int magnitude = exponent < 0 ? -exponent : exponent;
+    double scale = magnitude <= 22 ? powers[magnitude] : pow(10.0, magnitude);
+    result = exponent < 0 ? result / scale : result * scale;
+  }
+  *value = (float)(negative ? -result : result);
+  *p = s;
+  return true;
+}
+
+static bool ParseWord(const char **p, const char *end, const char *word) {
+  size_t length = strlen(word);
+  if ((size_t)(end - *p) < length || memcmp(*p, word, length) != 0) {
+    return false;
+  }
+  const char *after = *p + length;
+  if (after < end && *after != ' ' && *after != '\t') {
+    return false;
+  }
+  *p = after;
+  return true;
+}
+
+// Parses whole lines from begin to end, stopping at the first bad one
+static void ParseChunk(const char *begin, const char *end,
+                       ParsedRecords *records) {
+  records->Clear();
+  long long line = 0;
+  for (const char *p = begin; p < end;) {
+    const char *lineEnd = (const char *)memchr(p, '\n', end - p);
+    lineEnd = lineEnd ? lineEnd : end;
+    line++;
+
+    const char *s = p;
+    p = lineEnd + 1;
+    SkipSpaces(&s, lineEnd);
+    if (s == lineEnd || *s == '#') {
+      continue;
+    }
+
+    bool parsed = false;
+    if (ParseWord(&s, lineEnd, "segment")) {
+      SegmentRecord segment;
+      segment.line = line;
+      parsed = ParseInt(&s, lineEnd, &segment.id) &&
+               ParseFloat(&s, lineEnd, &segment.start.x) &&
+               ParseFloat(&s, lineEnd, &segment.start.y) &&
+               ParseFloat(&s, lineEnd, &segment.end.x) &&
+               ParseFloat(&s, lineEnd, &segment.end.y);
+      records->segments.push_back(segment);
+    } else {
+      LinkRecord link = {0, 0, 0, 0.0f, line};
+      if (ParseWord(&s, lineEnd, "connect")) {
+        parsed = ParseInt(&s, lineEnd, &link.a) &&
+                 ParseInt(&s, lineEnd, &link.b);
+        records->connects.push_back(link);
+      } else if (ParseWord(&s, lineEnd, "switch")) {
+        parsed = ParseInt(&s, lineEnd, &link.a) &&
+                 ParseInt(&s, lineEnd, &link.b) &&
+                 ParseInt(&s, lineEnd, &link.c);
+        records->switches.push_back(link);
+      } else if (ParseWord(&s, lineEnd, "signal")) {
+        parsed = ParseInt(&s, lineEnd, &link.a) &&
+                 ParseFloat(&s, lineEnd, &link.offset);
+        records->signals.push_back(link);
+      } else {
+        Fail(&records->error, line, "unknown record");
+        break;
+      }
+    }
+    SkipSpaces(&s, lineEnd);
+    if (!parsed || (s < lineEnd && *s != '#')) {
+      Fail(&records->error, line, "malformed record");
+      break;
+    }
+  }
+  records->lineCount = line;
+}
+
+// Moves a chunk's records onto the end of the file's, numbering their lines
+// from the start of the file
+static void Append(ParsedRecords *file, ParsedRecords *chunk) {
+  long long before = file->lineCount;
+  for (SegmentRecord &segment : chunk->segments) {
+    segment.line += before;
+    file->segments.push_back(segment);
+  }
+  std::vector<LinkRecord> *from[] = {&chunk->connects, &chunk->switches,
+                                     &chunk->signals};
+  std::vector<LinkRecord> *to[] = {&file->connects, &file->switches,
+                                   &file->signals};
+  for (int kind = 0; kind < 3; kind++) {
+    for (LinkRecord &link : *from[kind]) {
+      link.line += before;
+      to[kind]->push_back(link);
+    }
+  }
+  file->lineCount += chunk->lineCount;
+}
+
+// Builds the network once every record is in, checking references
+static bool Build(const ParsedRecords *file, TrackNetwork *network,
+                  LayoutTextError *error) {
+  // Segments by id
+  std::vector<int> record(file->segments.size(), -1);
+  for (size_t i = 0; i < file->segments.size(); i++) {
+    const SegmentRecord &segment = file->segments[i];
+    if (segment.id < 0 || segment.id >= (int)record.size()) {
+      Fail(error, segment.line, "segment %d out of range 0 to %d",
+           segment.id, (int)record.size() - 1);
+      return false;
+    }
+    if (record[segment.id] >= 0) {
+      Fail(error, segment.line, "segment %d defined twice", segment.id);
+      return false;
+    }
+    record[segment.id] = (int)i;
+  }
+  for (int index : record) {
+    const SegmentRecord &segment = file->segments[index];
+    network->AddSegment(segment.start, segment.end);
+  }
+
+  int segmentCount = network->SegmentCount();
+  for (const LinkRecord &connect : file->connects) {
+    if (connect.a < 0 || connect.a >= segmentCount || connect.b < 0 ||
+        connect.b >= segmentCount) {
+      Fail(error, connect.line, "connect refers to a missing segment");
+      return false;
+    }
+    network->Connect(connect.a, connect.b);
+  }
+  // Switches collect their legs as they are added, so they come after
+  // every connection
+  for (const LinkRecord &link : file->switches) {
+    if (link.a < 0 || link.a >= segmentCount || link.b < 0 ||
+        link.b >= segmentCount || link.c < 0 || link.c >= segmentCount) {
+      Fail(error, link.line, "switch refers to a missing segment");
+      return false;
+    }
+    if (network->segmentSwitch[link.a] >= 0) {
+      Fail(error, link.line, "segment %d already has a switch", link.a);
+      return false;
+    }
+    network->AddSwitch(link.a, link.b, link.c);
+  }
+  for (const LinkRecord &signal : file->signals) {
+    if (signal.a < 0 || signal.a >= segmentCount || signal.offset < 0.0f ||
+        signal.offset > network->segmentLength[signal.a]) {
+      Fail(error, signal.line, "signal is not on a segment");
+      return false;
+    }
+    network->AddSignal(signal.a, signal.offset);
+  }
+  return true;
+}
+
+bool ImportLayoutText(const char *path, TrackNetwork *network, JobSystem *jobs,
+                      LayoutTextError *error) {
+  *error = LayoutTextError();
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    Fail(error, 0, "cannot open %s", path);
+    return false;
+  }
+
+  ParsedRecords file;
+  std::vector<ParsedRecords> chunks;
+  std::vector<const char *> bounds;
+  std::vector<char> buffer;
+  size_t carried = 0; // Bytes of an unfinished last line
+  bool ok = true;
+  for (bool atEnd = false; ok && !atEnd;) {
+    buffer.resize(carried + blockSize);
+    size_t read = fread(buffer.data() + carried, 1, blockSize, in);
+    atEnd = read < blockSize;
+    size_t filled = carried + read;
+
+    // Parse up to the last newline; the rest waits for the next block,
+    // which grows the buffer if a single line is longer than a block
+    size_t complete = filled;
+    if (!atEnd) {
+      while (complete > 0 && buffer[complete - 1] != '\n') {
+        complete--;
+      }
+      if (complete == 0) {
+        carried = filled;
+        continue;
+      }
+    }
+
+    // Split at newlines into chunks for the job system
+    const char *begin = buffer.data();
+    const char *end = begin + complete;
+    size_t chunkCount = complete / minChunkSize + 1;
+    chunkCount = std::min(chunkCount, (size_t)jobs->ThreadCount() * 4);
+    bounds.assign(1, begin);
+    for (size_t i = 1; i < chunkCount; i++) {
+      const char *split = begin + complete * i / chunkCount;
+      split = std::max(split, bounds.back());
+      const char *newline = (const char *)memchr(split, '\n', end - split);
+      bounds.push_back(newline ? newline + 1 : end);
+    }
+    bounds.push_back(end);
+    chunks.resize(bounds.size() - 1);
+    jobs->ParallelFor(0, (int)chunks.size(), 1, [&](int first, int last) {
+      for (int i = first; i < last; i++) {
+        ParseChunk(bounds[i], bounds[i + 1], &chunks[i]);
+      }
+    });
+
+    for (ParsedRecords &chunk : chunks) {
+      if (chunk.error.line > 0) {
+        *error = chunk.error;
+        error->line += file.lineCount;
+        ok = false;
+        break;
+      }
+      Append(&file, &chunk);
+    }
+
+    carried = filled - complete;
+    memmove(buffer.data(), buffer.data() + complete, carried);
+  }
+  if (ferror(in)) {
+    Fail(error, 0, "cannot read %s", path);
+    ok = false;
+  }
+  fclose(in);
+
+  TrackNetwork built;
+  if (!ok || !Build(&file, &built, error)) {
+    return false;
+  }
+  *network = built;
+  return true;
+}
+
+bool ExportLayoutText(const char *path, const TrackNetwork &network) {
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    return false;
+  }
+  fprintf(out, "# %d segments, %d switches, %d signals\n",
+          network.SegmentCount(), network.SwitchCount(),
+          network.SignalCount());
+  for (int s = 0; s < network.SegmentCount(); s++) {
+    fprintf(out, "segment %d %.9g %.9g %.9g %.9g\n", s,
+            network.segmentStart[s].x, network.segmentStart[s].y,
+            network.segmentEnd[s].x, network.segmentEnd[s].y);
+  }
+  // A switch sets its approach's next segment itself
+  for (int s = 0; s < network.SegmentCount(); s++) {
+    if (network.segmentSwitch[s] < 0 && network.segmentNext[s] >= 0) {
+      fprintf(out, "connect %d %d\n", s, network.segmentNext[s]);
+    }
+  }
+  for (int w = 0; w < network.SwitchCount(); w++) {
+    fprintf(out, "switch %d %d %d\n", network.switchApproach[w],
+            network.switchNormal[w], network.switchReverse[w]);
+  }
+  for (int i = 0; i < network.SignalCount(); i++) {
+    fprintf(out, "signal %d %.9g\n", network.signalSegment[i],
+            network.signalOffset[i]);
+  }
+  return fclose(out) == 0;
+}
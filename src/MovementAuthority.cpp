@@ -0,0 +1,107 @@
+#include "MovementAuthority.h"
+#include <math.h>
+
+float MovementAuthority::ClearBeyond(const TrackNetwork &network,
+                                     const BitSet &occupied,
+                                     const BitSet *reserved, int segment,
+                                     ArenaVector<int> *chain) {
+  if (clearEpoch[segment] == epoch) {
+    return clearBeyond[segment];
+  }
+
+  // Walk ahead until an obstruction, a cached segment or twice the
+  // look-ahead cap, noting the clear distance beyond the last segment
+  // walked. A walk stopped by the cap only knows the track is clear as far
+  // as it went, which for the last segments walked may be short of the cap.
+  chain->clear();
+  float lastClear = 0.0f;
+  float walked = 0.0f;
+  bool isCut = false;
+  for (int current = segment;;) {
+    chain->push_back(current);
+    int next = network.NextSegment(current);
+    if (next < 0 || occupied.Test(next) ||
+        (reserved && !reserved->Test(next))) {
+      break;
+    }
+    walked += network.segmentLength[next];
+    if (walked >= 2.0f * maxLookahead) {
+      lastClear = network.segmentLength[next];
+      isCut = true;
+      break;
+    }
+    if (clearEpoch[next] == epoch) {
+      lastClear = network.segmentLength[next] + clearBeyond[next];
+      break;
+    }
+    current = next;
+  }
+
+  // Fill the cache back along the walked segments. After a cut only those
+  // known clear to the cap are exact; that is at least the first half of
+  // the walk, so the next walk along the line starts beyond it.
+  const ArenaVector<int> &path = *chain;
+  float clear = lastClear;
+  for (size_t i = path.size(); i-- > 0;) {
+    int current = path[i];
+    if (i + 1 < path.size()) {
+      clear += network.segmentLength[path[i + 1]];
+    }
+    if (!isCut || clear >= maxLookahead) {
+      clearBeyond[current] = clear < maxLookahead ? clear : maxLookahead;
+      clearEpoch[current] = epoch;
+    }
+  }
+  return clearBeyond[segment];
+}
+
+void MovementAuthority::Compute(const TrackNetwork &network,
+                                const BitSet &occupied,
+                                const BitSet *reserved,
+                                const HeadwayMonitor *intervals,
+                                const TrainFleet &fleet,
+                                const PackedTrain *trains,
+                                const std::vector<StockTables> &tables,
+                                Arena *scratch) {
+  if ((int)clearBeyond.size() != network.SegmentCount()) {
+    clearBeyond.assign(network.SegmentCount(), 0.0f);
+    clearEpoch.assign(network.SegmentCount(), 0);
+    epoch++;
+  }
+
+  int count = fleet.Count();
+  distance.resize(count);
+  speedLimit.resize(count);
+  ArenaAllocator<int> allocator(scratch);
+  ArenaVector<int> chain(allocator);
+
+  for (int i = 0; i < count; i++) {
+    int segment = fleet.segment[i];
+    float headOffset = fleet.offset[i];
+    float available = network.segmentLength[segment] - headOffset +
+                      ClearBeyond(network, occupied, reserved, segment, &chain);
+
+    // Another train ahead on the head's own segment
+    if (intervals) {
+      const std::vector<TrainInterval> &onSegment =
+          intervals->Intervals(segment);
+      for (const TrainInterval &interval : onSegment) {
+        if (interval.train != i && interval.rear >= headOffset &&
+            interval.rear - headOffset < available) {
+          available = interval.rear - headOffset;
+          break;
+        }
+      }
+    }
+    distance[i] = available;
+  }
+
+  // Braking curve: the speed from which the train stops within its
+  // authority at its weakest braking rate
+  for (int i = 0; i < count; i++) {
+    float braking = tables[trains[i].stock].minBraking;
+    float stopping = distance[i] - stoppingMargin;
+    stopping = stopping > 0.0f ? stopping : 0.0f;
+    speedLimit[i] = sqrtf(2.0f * braking * stopping);
+  }
+}
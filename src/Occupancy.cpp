@@ -0,0 +1,127 @@
+#include "Occupancy.h"
+
+void Occupancy::Resize(int segmentCount) {
+  *this = Occupancy();
+  occupied.Resize(segmentCount);
+  segmentFirst.assign(segmentCount, -1);
+}
+
+int Occupancy::OccupantCount(int segment) const {
+  int count = 0;
+  for (int node = segmentFirst[segment]; node >= 0;
+       node = nodeSegmentNext[node]) {
+    count++;
+  }
+  return count;
+}
+
+void Occupancy::Enter(int train, int segment) {
+  int node = freeNode;
+  if (node >= 0) {
+    freeNode = nodeTowardHead[node];
+  } else {
+    node = (int)nodeTrain.size();
+    nodeTrain.push_back(0);
+    nodeSegment.push_back(0);
+    nodeSegmentPrev.push_back(0);
+    nodeSegmentNext.push_back(0);
+    nodeTowardHead.push_back(0);
+  }
+  nodeTrain[node] = train;
+  nodeSegment[node] = segment;
+
+  // Link at the front of the segment's occupants
+  nodeSegmentPrev[node] = -1;
+  nodeSegmentNext[node] = segmentFirst[segment];
+  if (segmentFirst[segment] >= 0) {
+    nodeSegmentPrev[segmentFirst[segment]] = node;
+  }
+  segmentFirst[segment] = node;
+  occupied.Set(segment);
+
+  // Link at the head end of the train's segments
+  nodeTowardHead[node] = -1;
+  if (trainHead[train] >= 0) {
+    nodeTowardHead[trainHead[train]] = node;
+  } else {
+    trainTail[train] = node;
+  }
+  trainHead[train] = node;
+}
+
+void Occupancy::LeaveTail(int train) {
+  int node = trainTail[train];
+  int segment = nodeSegment[node];
+
+  trainTail[train] = nodeTowardHead[node];
+  if (trainTail[train] < 0) {
+    trainHead[train] = -1;
+  }
+
+  int prev = nodeSegmentPrev[node];
+  int next = nodeSegmentNext[node];
+  if (prev >= 0) {
+    nodeSegmentNext[prev] = next;
+  } else {
+    segmentFirst[segment] = next;
+  }
+  if (next >= 0) {
+    nodeSegmentPrev[next] = prev;
+  }
+  if (segmentFirst[segment] < 0) {
+    occupied.Reset(segment);
+  }
+
+  nodeTowardHead[node] = freeNode;
+  freeNode = node;
+}
+
+void Occupancy::Advance(int train, int headSegment, int tailSegment) {
+  if (train >= (int)trainHead.size()) {
+    trainHead.resize(train + 1, -1);
+    trainTail.resize(train + 1, -1);
+  }
+
+  int head = trainHead[train];
+  if (head < 0 || nodeSegment[head] != headSegment) {
+    // A head that moved back onto a segment it already holds means the
+    // train was placed by hand; start its list again
+    for (int node = trainTail[train]; node >= 0 && node != head;
+         node = nodeTowardHead[node]) {
+      if (nodeSegment[node] == headSegment) {
+        Remove(train);
+        break;
+      }
+    }
+    if (trainHead[train] < 0 && tailSegment != headSegment) {
+      Enter(train, tailSegment);
+    }
+    Enter(train, headSegment);
+  }
+
+  while (nodeSegment[trainTail[train]] != tailSegment &&
+         trainTail[train] != trainHead[train]) {
+    LeaveTail(train);
+  }
+}
+
+void Occupancy::Remove(int train) {
+  if (train >= (int)trainHead.size()) {
+    return;
+  }
+  while (trainTail[train] >= 0) {
+    LeaveTail(train);
+  }
+}
+
+void Occupancy::AddMemoryUsage(MemoryUsage *usage) const {
+  usage->Add(occupied.words);
+  usage->Add(segmentFirst);
+  usage->Add(trainTail);
+  usage->Add(trainHead);
+  usage->Add(nodeTrain);
+  usage->Add(nodeSegment);
+  usage->Add(nodeSegmentPrev);
+  usage->Add(nodeSegmentNext);
+  usage->Add(nodeTowardHead);
+}
@@ -0,0 +1,89 @@
+#include "PathHistory.h"
+#include <math.h>
+
+// Distances are rebased onto the oldest sample past this, to keep precision
+static const float rebaseDistance = 65536.0f;
+
+void PathHistory::Record(ImVec2 point, int segment) {
+  if (count >= 2 && samples[Physical(count - 1)].segment == segment &&
+      distance[Physical(count - 1)] - distance[Physical(count - 2)] <
+          minSpacing) {
+    count--;
+  }
+
+  float newDistance = 0.0f;
+  if (count > 0) {
+    const PathPoint &newest = samples[Physical(count - 1)];
+    float dx = point.x - newest.point.x;
+    float dy = point.y - newest.point.y;
+    newDistance = distance[Physical(count - 1)] + sqrtf(dx * dx + dy * dy);
+  }
+
+  if (count == capacity) {
+    oldest = (oldest + 1) % capacity;
+    count--;
+  }
+  int slot = Physical(count);
+  distance[slot] = newDistance;
+  samples[slot].point = point;
+  samples[slot].segment = segment;
+  count++;
+
+  if (newDistance > rebaseDistance) {
+    float base = distance[oldest];
+    for (int i = 0; i < count; i++) {
+      distance[Physical(i)] -= base;
+    }
+  }
+}
+
+PathPoint PathHistory::PointBehind(float behind) const {
+  PathPoint result;
+  result.point = ImVec2(0, 0);
+  result.segment = -1;
+  if (count == 0) {
+    return result;
+  }
+
+  float target = distance[Physical(count - 1)] - behind;
+  const PathPoint &first = samples[oldest];
+  if (count == 1 || target <= distance[oldest]) {
+    // Extend the path back along its oldest direction
+    float dirX = 1.0f;
+    float dirY = 0.0f;
+    if (count > 1) {
+      const PathPoint &second = samples[Physical(1)];
+      float length = distance[Physical(1)] - distance[oldest];
+      if (length > 0) {
+        dirX = (second.point.x - first.point.x) / length;
+        dirY = (second.point.y - first.point.y) / length;
+      }
+    }
+    float extra = distance[oldest] - target;
+    result.point =
+        ImVec2(first.point.x - dirX * extra, first.point.y - dirY * extra);
+    result.segment = first.segment;
+    return result;
+  }
+
+  // First sample at or past the target distance
+  int low = 1;
+  int high = count - 1;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (distance[Physical(mid)] < target) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  const PathPoint &before = samples[Physical(low - 1)];
+  const PathPoint &after = samples[Physical(low)];
+  float span = distance[Physical(low)] - distance[Physical(low - 1)];
+  float t = span > 0 ? (target - distance[Physical(low - 1)]) / span : 1.0f;
+  result.point = ImVec2(before.point.x + (after.point.x - before.point.x) * t,
+                        before.point.y + (after.point.y - before.point.y) * t);
+  result.segment = t > 0 ? after.segment : before.segment;
+  return result;
+}
@@ -0,0 +1,734 @@
+#include "RailmlImport.h"
+#include <algorithm>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Read this much of the file at a time; a single tag longer than this grows
+// the buffer
+static const size_t blockSize = 1 << 20;
+// Positions along a track closer than this, in metres, are the same point
+static const float samePosition = 1e-3f;
+
+static void Fail(RailmlError *error, long long line, const char *format,
+                 ...) {
+  error->line = line;
+  va_list args;
+  va_start(args, format);
+  vsnprintf(error->message, sizeof(error->message), format, args);
+  va_end(args);
+}
+
+struct XmlAttribute {
+  std::string name;
+  std::string value;
+};
+
+// A start or end tag, named without any namespace prefix. The attribute
+// strings keep their storage from tag to tag.
+struct XmlElement {
+  std::string name;
+  std::vector<XmlAttribute> attributes;
+  int attributeCount = 0;
+  long long line = 0;
+
+  const char *Find(const char *attribute) const {
+    for (int i = 0; i < attributeCount; i++) {
+      if (attributes[i].name == attribute) {
+        return attributes[i].value.c_str();
+      }
+    }
+    return nullptr;
+  }
+};
+
+enum XmlEvent_ {
+  XmlEvent_Start,
+  XmlEvent_End,
+  XmlEvent_Finished,
+  XmlEvent_Error
+};
+
+// Pulls the tags out of an XML file a block at a time, checking that they
+// nest. Text, comments, CDATA, processing instructions and declarations are
+// skipped, as railML keeps everything the importer reads in attributes. An
+// empty-element tag comes out as a start followed by an end.
+class XmlReader {
+public:
+  explicit XmlReader(FILE *in) : in(in) {}
+
+  XmlEvent_ Next(XmlElement *element, RailmlError *error);
+
+private:
+  FILE *in;
+  std::vector<char> buffer;
+  size_t position = 0; // Next byte to read
+  size_t filled = 0;
+  bool atEnd = false;
+  long long line = 1;
+  std::vector<std::string> open; // Names of the unclosed elements
+  int depth = 0;                 // In use; the rest keep their storage
+  bool closeEmpty = false;       // The last start was an empty element
+
+  bool Fill();
+  void CountLines(size_t end);
+  bool FindEnd(size_t *end) const;
+  void ParseTag(const char *p, const char *end, XmlElement *element,
+                bool *empty);
+};
+
+// Moves the unread bytes to the front and reads another block after them;
+// false once nothing more can be read
+bool XmlReader::Fill() {
+  if (atEnd) {
+    return false;
+  }
+  filled -= position;
+  if (buffer.size() < filled + blockSize) {
+    buffer.resize(filled + blockSize);
+  }
+  memmove(buffer.data(), buffer.data() + position, filled);
+  position = 0;
+  size_t read = fread(buffer.data() + filled, 1, blockSize, in);
+  filled += read;
+  atEnd = read < blockSize;
+  return read > 0;
+}
+
+void XmlReader::CountLines(size_t end) {
+  line += std::count(buffer.data() + position, buffer.data() + end, '\n');
+  position = end;
+}
+
+static const char *Search(const char *begin, const char *end,
+                          const char *pattern) {
+  const char *found =
+      std::search(begin, end, pattern, pattern + strlen(pattern));
+  return found == end ? nullptr : found;
+}
+
+static bool StartsWith(const char *begin, const char *end, const char *text) {
+  size_t length = strlen(text);
+  return (size_t)(end - begin) >= length && memcmp(begin, text, length) == 0;
+}
+
+// Finds the end of the markup starting at `position`, which is a '<'; false
+// if it does not end within the buffer
+bool XmlReader::FindEnd(size_t *end) const {
+  const char *base = buffer.data();
+  const char *p = base + position;
+  const char *last = base + filled;
+  // Leave a prefix cut short by the end of the buffer for the next fill
+  if (!atEnd && last - p < 9) {
+    return false;
+  }
+  const char *close = nullptr;
+  if (StartsWith(p, last, "<!--")) {
+    close = Search(p + 4, last, "-->");
+    close = close ? close + 3 : nullptr;
+  } else if (StartsWith(p, last, "<![CDATA[")) {
+    close = Search(p + 9, last, "]]>");
+    close = close ? close + 3 : nullptr;
+  } else if (StartsWith(p, last, "<?")) {
+    close = Search(p + 2, last, "?>");
+    close = close ? close + 2 : nullptr;
+  } else {
+    // A tag or declaration ends at the first '>' outside quotes
+    char quote = 0;
+    for (const char *s = p + 1; s < last && !close; s++) {
+      if (quote) {
+        quote = *s == quote ? 0 : quote;
+      } else if (*s == '"' || *s == '\'') {
+        quote = *s;
+      } else if (*s == '>') {
+        close = s + 1;
+      }
+    }
+  }
+  if (!close) {
+    return false;
+  }
+  *end = (size_t)(close - base);
+  return true;
+}
+
+static bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static void Decode(const char *begin, const char *end, std::string *text) {
+  static const char *const entities[][2] = {{"&amp;", "&"},
+                                            {"&lt;", "<"},
+                                            {"&gt;", ">"},
+                                            {"&quot;", "\""},
+                                            {"&apos;", "'"}};
+  text->clear();
+  for (const char *p = begin; p < end;) {
+    const char *amp = (const char *)memchr(p, '&', end - p);
+    if (!amp) {
+      text->append(p, end);
+      break;
+    }
+    text->append(p, amp);
+    p = amp + 1;
+    text->push_back('&');
+    for (const auto &entity : entities) {
+      if (StartsWith(amp, end, entity[0])) {
+        text->back() = entity[1][0];
+        p = amp + strlen(entity[0]);
+        break;
+      }
+    }
+  }
+}
+
+// Reads the name and attributes of the tag between p, just after the '<',
+// and end, at the '>'
+void XmlReader::ParseTag(const char *p, const char *end, XmlElement *element,
+                         bool *empty) {
+  const char *name = p;
+  while (p < end && !IsSpace(*p) && *p != '/') {
+    p++;
+  }
+  const char *colon = (const char *)memchr(name, ':', p - name);
+  element->name.assign(colon ? colon + 1 : name, p);
+  element->attributeCount = 0;
+  *empty = false;
+  while (p < end) {
+    while (p < end && IsSpace(*p)) {
+      p++;
+    }
+    if (p < end && *p == '/') {
+      *empty = true;
+      break;
+    }
+    const char *attribute = p;
+    while (p < end && *p != '=' && !IsSpace(*p)) {
+      p++;
+    }
+    const char *attributeEnd = p;
+    while (p < end && (IsSpace(*p) || *p == '=')) {
+      p++;
+    }
+    if (p == end || (*p != '"' && *p != '\'')) {
+      break;
+    }
+    const char *value = p + 1;
+    const char *valueEnd = (const char *)memchr(value, *p, end - value);
+    valueEnd = valueEnd ? valueEnd : end;
+    p = valueEnd + 1;
+
+    if ((int)element->attributes.size() == element->attributeCount) {
+      element->attributes.push_back(XmlAttribute());
+    }
+    XmlAttribute &added = element->attributes[element->attributeCount++];
+    added.name.assign(attribute, attributeEnd);
+    Decode(value, valueEnd, &added.value);
+  }
+}
+
+XmlEvent_ XmlReader::Next(XmlElement *element, RailmlError *error) {
+  if (closeEmpty) {
+    closeEmpty = false;
+    depth--;
+    return XmlEvent_End;
+  }
+  for (;;) {
+    const char *base = buffer.data();
+    const char *tag =
+        position < filled
+            ? (const char *)memchr(base + position, '<', filled - position)
+            : nullptr;
+    if (!tag) {
+      CountLines(filled);
+      if (!Fill()) {
+        break;
+      }
+      continue;
+    }
+    CountLines((size_t)(tag - base));
+    size_t end;
+    while (!FindEnd(&end)) {
+      if (atEnd) {
+        Fail(error, line, "unterminated markup");
+        return XmlEvent_Error;
+      }
+      Fill();
+    }
+    base = buffer.data();
+    const char *p = base + position + 1;
+    long long tagLine = line;
+    CountLines(end);
+    if (*p == '!' || *p == '?') {
+      continue;
+    }
+
+    element->line = tagLine;
+    bool closing = *p == '/';
+    bool empty;
+    ParseTag(p + closing, base + end - 1, element, &empty);
+    if (closing) {
+      if (depth == 0 || open[depth - 1] != element->name) {
+        Fail(error, tagLine, "</%.40s> does not close an open element",
+             element->name.c_str());
+        return XmlEvent_Error;
+      }
+      depth--;
+      return XmlEvent_End;
+    }
+    if ((int)open.size() == depth) {
+      open.push_back(std::string());
+    }
+    open[depth++] = element->name;
+    closeEmpty = empty;
+    return XmlEvent_Start;
+  }
+  if (ferror(in)) {
+    Fail(error, 0, "cannot read the file");
+    return XmlEvent_Error;
+  }
+  if (depth > 0) {
+    Fail(error, line, "<%.40s> is not closed", open[depth - 1].c_str());
+    return XmlEvent_Error;
+  }
+  return XmlEvent_Finished;
+}
+
+// What a connection id belongs to
+enum ConnectionAt_ {
+  ConnectionAt_TrackBegin,
+  ConnectionAt_TrackEnd,
+  ConnectionAt_Switch
+};
+
+struct ConnectionEnd {
+  ConnectionAt_ at;
+  int track;
+};
+
+// A track once its segments are in the network
+struct TrackRecord {
+  int firstSegment;
+  int lastSegment;
+  std::string beginRef; // Connection the trackBegin leads to, if any
+  std::string endRef;
+};
+
+// A switch once its track's segments are in the network. It sits at the
+// start of segment boundary - 1 of its track, where boundary 0 is the
+// trackBegin and the track's segment count is the trackEnd.
+struct SwitchRecord {
+  int track;
+  int boundary;
+  std::string ref;
+};
+
+// A point along the current track with its coordinates
+struct TrackSample {
+  float pos;
+  ImVec2 point;
+
+  bool operator<(const TrackSample &other) const { return pos < other.pos; }
+};
+
+// The element whose geoCoord and connection children are being read
+enum Owner_ {
+  Owner_None,
+  Owner_TrackBegin,
+  Owner_TrackEnd,
+  Owner_Switch,
+  Owner_GeoMapping,
+  Owner_Other
+};
+
+// Builds the network from the tags of a railML file as they stream past
+class RailmlBuilder {
+public:
+  explicit RailmlBuilder(TrackNetwork *network) : network(network) {}
+
+  bool Start(const XmlElement &element, RailmlError *error);
+  bool End(const XmlElement &element, RailmlError *error);
+  // Joins the tracks and adds the switches once every track is in
+  void Finish();
+
+private:
+  TrackNetwork *network;
+  std::unordered_map<std::string, ConnectionEnd> connections;
+  std::vector<TrackRecord> tracks;
+  std::vector<SwitchRecord> switches;
+
+  // The track being read
+  bool inTrack = false;
+  std::string trackId;
+  long long trackLine = 0;
+  float beginPos = 0.0f;
+  float endPos = 0.0f;
+  bool hasBegin = false;
+  bool hasEnd = false;
+  std::string beginRef;
+  std::string endRef;
+  std::vector<TrackSample> samples;
+  std::vector<float> splits;
+  std::vector<float> switchPos;
+  std::vector<std::string> switchRef;
+  std::vector<float> signalPos;
+  Owner_ owner = Owner_None;
+  float ownerPos = 0.0f;
+
+  bool FinishTrack(RailmlError *error);
+  ImVec2 PointAt(float pos) const;
+  const ConnectionEnd *Find(const std::string &id) const;
+};
+
+static bool ParsePos(const XmlElement &element, float *pos,
+                     RailmlError *error) {
+  const char *text = element.Find("pos");
+  char *end = nullptr;
+  *pos = text ? strtof(text, &end) : 0.0f;
+  if (!text || end == text) {
+    Fail(error, element.line, "<%.40s> has no pos", element.name.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool RailmlBuilder::Start(const XmlElement &element, RailmlError *error) {
+  const std::string &name = element.name;
+  if (name == "track") {
+    if (inTrack) {
+      Fail(error, element.line, "track inside a track");
+      return false;
+    }
+    const char *id = element.Find("id");
+    inTrack = true;
+    trackId = id ? id : "";
+    trackLine = element.line;
+    hasBegin = hasEnd = false;
+    beginRef.clear();
+    endRef.clear();
+    samples.clear();
+    splits.clear();
+    switchPos.clear();
+    switchRef.clear();
+    signalPos.clear();
+    owner = Owner_None;
+    return true;
+  }
+  if (!inTrack) {
+    return true;
+  }
+
+  if (name == "trackBegin" || name == "trackEnd" || name == "switch" ||
+      name == "geoMapping") {
+    bool begin = name == "trackBegin";
+    // A trackBegin without a pos is at the start of the track
+    if (begin && !element.Find("pos")) {
+      ownerPos = 0.0f;
+    } else if (!ParsePos(element, &ownerPos, error)) {
+      return false;
+    }
+    if (begin) {
+      owner = Owner_TrackBegin;
+      beginPos = ownerPos;
+      hasBegin = true;
+    } else if (name == "trackEnd") {
+      owner = Owner_TrackEnd;
+      endPos = ownerPos;
+      hasEnd = true;
+    } else if (name == "switch") {
+      owner = Owner_Switch;
+      switchPos.push_back(ownerPos);
+      switchRef.push_back(std::string());
+    } else {
+      owner = Owner_GeoMapping;
+    }
+  } else if (name == "crossing") {
+    owner = Owner_Other;
+  } else if (name == "signal") {
+    float pos;
+    if (!ParsePos(element, &pos, error)) {
+      return false;
+    }
+    signalPos.push_back(pos);
+    owner = Owner_Other;
+  } else if (name == "connection") {
+    const char *id = element.Find("id");
+    const char *ref = element.Find("ref");
+    ConnectionEnd end = {ConnectionAt_Switch, (int)tracks.size()};
+    std::string *refs = nullptr;
+    if (owner == Owner_TrackBegin) {
+      end.at = ConnectionAt_TrackBegin;
+      refs = &beginRef;
+    } else if (owner == Owner_TrackEnd) {
+      end.at = ConnectionAt_TrackEnd;
+      refs = &endRef;
+    } else if (owner == Owner_Switch) {
+      // A switch with more connections is a three-way switch; only its
+      // first branch fits the network
+      refs = switchRef.back().empty() ? &switchRef.back() : nullptr;
+    } else {
+      return true;
+    }
+    if (!id) {
+      Fail(error, element.line, "connection has no id");
+      return false;
+    }
+    if (!connections.insert(std::make_pair(std::string(id), end)).second) {
+      Fail(error, element.line, "connection %.40s defined twice", id);
+      return false;
+    }
+    if (refs && ref) {
+      *refs = ref;
+    }
+  } else if (name == "geoCoord" && owner != Owner_None &&
+             owner != Owner_Other) {
+    // "x y", or "x y z" with the height ignored
+    const char *coord = element.Find("coord");
+    char *end = nullptr;
+    TrackSample sample;
+    sample.pos = ownerPos;
+    sample.point.x = coord ? strtof(coord, &end) : 0.0f;
+    const char *y = end;
+    sample.point.y = coord && end != coord ? -strtof(y, &end) : 0.0f;
+    if (!coord || end == y) {
+      Fail(error, element.line, "geoCoord has no x and y");
+      return false;
+    }
+    samples.push_back(sample);
+    if (owner == Owner_GeoMapping) {
+      splits.push_back(ownerPos);
+    }
+  }
+  return true;
+}
+
+bool RailmlBuilder::End(const XmlElement &element, RailmlError *error) {
+  const std::string &name = element.name;
+  if (!inTrack) {
+    return true;
+  }
+  if (name == "track") {
+    inTrack = false;
+    return FinishTrack(error);
+  }
+  if (name == "trackBegin" || name == "trackEnd" || name == "switch" ||
+      name == "geoMapping" || name == "crossing" || name == "signal") {
+    owner = Owner_None;
+  }
+  return true;
+}
+
+// Coordinates at `pos`, interpolated between the samples on either side
+ImVec2 RailmlBuilder::PointAt(float pos) const {
+  size_t after = std::upper_bound(samples.begin(), samples.end(),
+                                  TrackSample{pos, ImVec2()}) -
+                 samples.begin();
+  after = std::min(std::max(after, (size_t)1), samples.size() - 1);
+  const TrackSample &a = samples[after - 1];
+  const TrackSample &b = samples[after];
+  float t = b.pos > a.pos ? (pos - a.pos) / (b.pos - a.pos) : 0.0f;
+  return ImVec2(a.point.x + (b.point.x - a.point.x) * t,
+                a.point.y + (b.point.y - a.point.y) * t);
+}
+
+bool RailmlBuilder::FinishTrack(RailmlError *error) {
+  const char *id = trackId.c_str();
+  if (!hasBegin || !hasEnd || endPos < beginPos) {
+    Fail(error, trackLine, "track %.40s has no trackBegin and trackEnd", id);
+    return false;
+  }
+  bool placedBegin = false;
+  bool placedEnd = false;
+  for (const TrackSample &sample : samples) {
+    placedBegin |= sample.pos <= beginPos + samePosition;
+    placedEnd |= sample.pos >= endPos - samePosition;
+  }
+  if (!placedBegin || !placedEnd) {
+    Fail(error, trackLine, "track %.40s has no geoCoord at each end", id);
+    return false;
+  }
+  std::stable_sort(samples.begin(), samples.end());
+  // PointAt interpolates between two samples, and a track placed by one
+  // point would have no length anyway
+  if (samples.back().pos <= samples.front().pos) {
+    Fail(error, trackLine, "track %.40s has geoCoords at only one pos", id);
+    return false;
+  }
+
+  // Segment boundaries, from trackBegin to trackEnd
+  splits.insert(splits.end(), switchPos.begin(), switchPos.end());
+  std::sort(splits.begin(), splits.end());
+  std::vector<float> &boundaries = splits;
+  size_t kept = 0;
+  float previous = beginPos;
+  for (float pos : splits) {
+    if (pos > previous + samePosition && pos < endPos - samePosition) {
+      boundaries[kept++] = previous = pos;
+    }
+  }
+  boundaries.resize(kept);
+  boundaries.insert(boundaries.begin(), beginPos);
+  boundaries.push_back(endPos);
+
+  TrackRecord track;
+  track.firstSegment = network->SegmentCount();
+  for (size_t i = 0; i + 1 < boundaries.size(); i++) {
+    int segment = network->AddSegment(PointAt(boundaries[i]),
+                                      PointAt(boundaries[i + 1]));
+    if (i > 0) {
+      network->Connect(segment - 1, segment);
+    }
+  }
+  track.lastSegment = network->SegmentCount() - 1;
+  track.beginRef.swap(beginRef);
+  track.endRef.swap(endRef);
+
+  for (size_t i = 0; i < switchPos.size(); i++) {
+    if (switchRef[i].empty()) {
+      continue;
+    }
+    SwitchRecord added;
+    added.track = (int)tracks.size();
+    added.boundary = (int)(std::lower_bound(boundaries.begin(),
+                                            boundaries.end(),
+                                            switchPos[i] - samePosition) -
+                           boundaries.begin());
+    added.boundary = std::min(added.boundary, (int)boundaries.size() - 1);
+    added.ref.swap(switchRef[i]);
+    switches.push_back(added);
+  }
+
+  for (float pos : signalPos) {
+    pos = std::min(std::max(pos, beginPos), endPos);
+    int i = (int)(std::upper_bound(boundaries.begin(), boundaries.end(), pos) -
+                  boundaries.begin()) -
+            1;
+    i = std::min(i, (int)boundaries.size() - 2);
+    int segment = track.firstSegment + i;
+    float span = boundaries[i + 1] - boundaries[i];
+    float along = span > 0 ? (pos - boundaries[i]) / span : 0.0f;
+    network->AddSignal(segment, along * network->segmentLength[segment]);
+  }
+
+  tracks.push_back(track);
+  return true;
+}
+
+const ConnectionEnd *RailmlBuilder::Find(const std::string &id) const {
+  if (id.empty()) {
+    return nullptr;
+  }
+  auto found = connections.find(id);
+  return found == connections.end() ? nullptr : &found->second;
+}
+
+void RailmlBuilder::Finish() {
+  // Tracks that follow one another
+  for (size_t t = 0; t < tracks.size(); t++) {
+    const ConnectionEnd *next = Find(tracks[t].endRef);
+    if (next && next->at == ConnectionAt_TrackBegin) {
+      network->Connect(tracks[t].lastSegment,
+                       tracks[next->track].firstSegment);
+    }
+    const ConnectionEnd *previous = Find(tracks[t].beginRef);
+    if (previous && previous->at == ConnectionAt_TrackEnd) {
+      network->Connect(tracks[previous->track].lastSegment,
+                       tracks[t].firstSegment);
+    }
+  }
+
+  // Where each switch's approach and continuing track are, or -1 at an
+  // open end of track
+  std::vector<int> approach(switches.size(), -1);
+  std::vector<int> normal(switches.size(), -1);
+  for (size_t i = 0; i < switches.size(); i++) {
+    const SwitchRecord &added = switches[i];
+    const TrackRecord &track = tracks[added.track];
+    int segmentCount = track.lastSegment - track.firstSegment + 1;
+    if (added.boundary > 0) {
+      approach[i] = track.firstSegment + added.boundary - 1;
+    } else {
+      const ConnectionEnd *previous = Find(track.beginRef);
+      bool joined = previous && previous->at == ConnectionAt_TrackEnd;
+      approach[i] = joined ? tracks[previous->track].lastSegment : -1;
+    }
+    if (added.boundary < segmentCount) {
+      normal[i] = track.firstSegment + added.boundary;
+    } else {
+      const ConnectionEnd *next = Find(track.endRef);
+      bool joined = next && next->at == ConnectionAt_TrackBegin;
+      normal[i] = joined ? tracks[next->track].firstSegment : -1;
+    }
+  }
+
+  // Merging tracks first, as a switch collects the segments of its legs
+  // when it is added
+  for (size_t i = 0; i < switches.size(); i++) {
+    const ConnectionEnd *branch = Find(switches[i].ref);
+    if (branch && branch->at == ConnectionAt_TrackEnd && normal[i] >= 0) {
+      network->Connect(tracks[branch->track].lastSegment, normal[i]);
+    }
+  }
+  // A switch's legs end at the next switch, so every approach is marked
+  // with the index its switch will have before any is added
+  std::vector<int> diverging;
+  for (size_t i = 0; i < switches.size(); i++) {
+    const ConnectionEnd *branch = Find(switches[i].ref);
+    if (branch && branch->at == ConnectionAt_TrackBegin && approach[i] >= 0 &&
+        normal[i] >= 0 && network->segmentSwitch[approach[i]] < 0) {
+      network->segmentSwitch.Set(approach[i], (int)diverging.size());
+      diverging.push_back((int)i);
+    }
+  }
+  for (int i : diverging) {
+    const ConnectionEnd *branch = Find(switches[i].ref);
+    network->AddSwitch(approach[i], normal[i],
+                       tracks[branch->track].firstSegment);
+  }
+}
+
+bool ImportRailml(const char *path, TrackNetwork *network,
+                  RailmlError *error) {
+  *error = RailmlError();
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    Fail(error, 0, "cannot open %s", path);
+    return false;
+  }
+
+  TrackNetwork built;
+  RailmlBuilder builder(&built);
+  XmlReader reader(in);
+  XmlElement element;
+  bool ok = true;
+  bool railml = false;
+  while (ok) {
+    XmlEvent_ event = reader.Next(&element, error);
+    if (event == XmlEvent_Finished) {
+      break;
+    }
+    if (event == XmlEvent_Error) {
+      ok = false;
+    } else if (event == XmlEvent_Start) {
+      railml = railml || element.name == "railml";
+      ok = builder.Start(element, error);
+    } else {
+      ok = builder.End(element, error);
+    }
+  }
+  fclose(in);
+  if (ok && !railml) {
+    Fail(error, 0, "%s is not a railML file", path);
+    ok = false;
+  }
+  if (!ok) {
+    return false;
+  }
+  builder.Finish();
+  *network = built;
+  return true;
+}
@@ -0,0 +1,225 @@
+#include "RegionSimulation.h"
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+std::vector<int> PartitionSegments(const TrackNetwork &network,
+                                   int regionCount) {
+  std::vector<int> regionOfSegment(network.SegmentCount());
+  for (int segment = 0; segment < network.SegmentCount(); segment++) {
+    regionOfSegment[segment] =
+        (int)((long long)segment * regionCount / network.SegmentCount());
+  }
+  return regionOfSegment;
+}
+
+void RegionSimulation::Build(const TrackNetwork &network,
+                             const std::vector<int> &regionOfSegment,
+                             const std::vector<StockTables> &stock) {
+  StopWorkers();
+  segmentRegion = regionOfSegment;
+  int regionCount = 0;
+  for (int region : segmentRegion) {
+    regionCount = region + 1 > regionCount ? region + 1 : regionCount;
+  }
+
+  regions.clear();
+  for (int i = 0; i < regionCount; i++) {
+    regions.push_back(std::unique_ptr<RegionState>(new RegionState()));
+    regions[i]->simulation.stock = stock;
+    regions[i]->simulation.Reset(network);
+  }
+  queues.clear();
+  for (int i = 0; i < regionCount * regionCount; i++) {
+    queues.push_back(std::unique_ptr<SpscQueue<TrainHandoff>>(
+        new SpscQueue<TrainHandoff>(queueCapacity)));
+  }
+  occupied.Resize(network.SegmentCount());
+  occupancyChanged = true;
+  trainRegion.clear();
+  trainHandle.clear();
+
+  for (int region = 0; region < regionCount; region++) {
+    workers.push_back(std::thread(&RegionSimulation::WorkerLoop, this,
+                                  region));
+  }
+}
+
+int RegionSimulation::AddTrain(const TrackNetwork &network, int headSegment,
+                               float headOffset, float length, int stockIndex,
+                               float trainLineSpeed) {
+  int id = (int)trainRegion.size();
+  RegionState &region = *regions[segmentRegion[headSegment]];
+  int index = region.simulation.AddTrain(network, headSegment, headOffset,
+                                         length, stockIndex, trainLineSpeed);
+  trainRegion.push_back(0);
+  trainHandle.push_back(TrainHandle());
+  SetTrainId(segmentRegion[headSegment], index, id);
+
+  const Occupancy &occupancy = region.simulation.occupancy;
+  for (int node = occupancy.TailNode(index); node >= 0;
+       node = occupancy.NextTowardHead(node)) {
+    occupied.Set(occupancy.SegmentOf(node));
+  }
+  occupancyChanged = true;
+  return id;
+}
+
+// Records the id of a train just placed in the region
+void RegionSimulation::SetTrainId(int region, int train, int id) {
+  RegionState &own = *regions[region];
+  TrainHandle handle = own.simulation.Handle(train);
+  own.slotId.resize(own.simulation.pool.SlotCount());
+  own.slotId[handle.slot] = id;
+  trainRegion[id] = region;
+  trainHandle[id] = handle;
+}
+
+void RegionSimulation::Adopt(const TrackNetwork &network, int region) {
+  RegionState &own = *regions[region];
+  TrainHandoff handoff;
+  for (int from = 0; from < RegionCount(); from++) {
+    SpscQueue<TrainHandoff> &queue = Queue(from, region);
+    while (queue.TryPop(&handoff)) {
+      int index = own.simulation.PlaceTrain(
+          network, handoff.headSegment, handoff.headOffset,
+          handoff.tailSegment, handoff.tailOffset, handoff.speed,
+          handoff.acceleration, handoff.stock, handoff.lineSpeed);
+      SetTrainId(region, index, handoff.id);
+    }
+  }
+}
+
+void RegionSimulation::HandOver(int region) {
+  RegionState &own = *regions[region];
+  Simulation &simulation = own.simulation;
+  TrainFleet &fleet = simulation.fleet;
+
+  // Walk down so the train moved into a removed train's index has already
+  // been looked at
+  for (int i = fleet.Count() - 1; i >= 0; i--) {
+    int to = segmentRegion[fleet.segment[i]];
+    if (to == region) {
+      continue;
+    }
+    TrainHandoff handoff;
+    handoff.id = own.slotId[simulation.Handle(i).slot];
+    handoff.headSegment = fleet.segment[i];
+    handoff.headOffset = fleet.offset[i];
+    handoff.tailSegment = simulation.packed[i].tailSegment;
+    handoff.tailOffset = fleet.tailOffset[i];
+    handoff.speed = fleet.speed[i];
+    handoff.acceleration = fleet.acceleration[i];
+    handoff.stock = simulation.packed[i].stock;
+    handoff.lineSpeed = simulation.packed[i].LineSpeed();
+    // A full queue leaves the train here, to be offered again next tick
+    if (!Queue(region, to).TryPush(handoff)) {
+      continue;
+    }
+
+    simulation.RemoveTrain(i);
+  }
+}
+
+bool RegionSimulation::MergeOccupancy(int wordBegin, int wordEnd) {
+  bool changed = false;
+  for (int word = wordBegin; word < wordEnd; word++) {
+    uint64_t bits = 0;
+    for (const std::unique_ptr<RegionState> &region : regions) {
+      bits |= region->simulation.occupancy.occupied.words[word];
+    }
+    changed |= bits != occupied.words[word];
+    occupied.words[word] = bits;
+  }
+  return changed;
+}
+
+void RegionSimulation::RunRegion(Phase current, int region) {
+  if (current == Phase_Step) {
+    Simulation &simulation = regions[region]->simulation;
+    if (occupancyChanged) {
+      simulation.authority.Invalidate();
+    }
+    simulation.Step(*stepNetwork, &occupied, nullptr, nullptr, stepDt,
+                    nullptr);
+    HandOver(region);
+  } else if (current == Phase_Adopt) {
+    Adopt(*stepNetwork, region);
+  } else if (current == Phase_Merge) {
+    int wordCount = occupied.WordCount();
+    int begin = (int)((long long)wordCount * region / RegionCount());
+    int end = (int)((long long)wordCount * (region + 1) / RegionCount());
+    if (MergeOccupancy(begin, end)) {
+      mergeChanged = true;
+    }
+  }
+}
+
+void RegionSimulation::WorkerLoop(int region) {
+#ifdef __linux__
+  int coreCount = (int)std::thread::hardware_concurrency();
+  if (coreCount > 0) {
+    cpu_set_t cores;
+    CPU_ZERO(&cores);
+    CPU_SET(region % coreCount, &cores);
+    pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores);
+  }
+#endif
+  unsigned seen = 0;
+  for (;;) {
+    Phase current;
+    {
+      std::unique_lock<std::mutex> lock(phaseMutex);
+      phaseStart.wait(lock, [&] { return phaseCount != seen; });
+      seen = phaseCount;
+      current = phase;
+    }
+    if (current == Phase_Stop) {
+      return;
+    }
+    RunRegion(current, region);
+    std::lock_guard<std::mutex> lock(phaseMutex);
+    if (--running == 0) {
+      phaseDone.notify_one();
+    }
+  }
+}
+
+// Starts every worker on the phase and waits for all of them, so whatever
+// one phase wrote is visible to the next through the mutex
+void RegionSimulation::RunPhase(Phase next) {
+  std::unique_lock<std::mutex> lock(phaseMutex);
+  phase = next;
+  phaseCount++;
+  running = (int)workers.size();
+  phaseStart.notify_all();
+  phaseDone.wait(lock, [&] { return running == 0; });
+}
+
+void RegionSimulation::StopWorkers() {
+  if (workers.empty()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(phaseMutex);
+    phase = Phase_Stop;
+    phaseCount++;
+  }
+  phaseStart.notify_all();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  workers.clear();
+}
+
+void RegionSimulation::Step(const TrackNetwork &network, float dt) {
+  stepNetwork = &network;
+  stepDt = dt;
+  RunPhase(Phase_Step);
+  // Every push happened before the step phase finished, so each region
+  // can now empty its inbound queues
+  RunPhase(Phase_Adopt);
+  mergeChanged = false;
+  RunPhase(Phase_Merge);
+  occupancyChanged = mergeChanged;
+}
@@ -0,0 +1,92 @@
+#include "SegmentColors.h"
+#include "Colors.h"
+
+SegmentColors::SegmentColors() {
+  // A conflict shows over a train, and a train over the route it is on
+  for (int state = 0; state < SegmentState_COUNT; state++) {
+    if (state & (SegmentState_Blocked | SegmentState_SwitchAgainst)) {
+      table[state] = RED;
+    } else if (state & SegmentState_Occupied) {
+      table[state] = YELLOW;
+    } else if (state & SegmentState_Reserved) {
+      table[state] = GREEN;
+    } else {
+      table[state] = ORANGE;
+    }
+  }
+}
+
+void SegmentColors::Resize(int segmentCount) {
+  BitSet *bitSets[] = {&occupied,      &reserved,          &blocked,
+                       &switchAgainst, &lastOccupied,      &lastReserved,
+                       &lastBlocked,   &lastSwitchAgainst};
+  for (BitSet *bitSet : bitSets) {
+    bitSet->Resize(segmentCount);
+  }
+  lastSwitchReversed.clear();
+  colors.assign(segmentCount, 0);
+  refreshAll = true;
+}
+
+int SegmentColors::Update(const TrackNetwork &network) {
+  changed.clear();
+
+  // Rebuild the switch-against bits only for legs of switches that moved
+  lastSwitchReversed.resize(network.SwitchCount(), 2);
+  for (int s = 0; s < network.SwitchCount(); s++) {
+    unsigned char reversed = network.switchReversed[s];
+    if (reversed == lastSwitchReversed[s]) {
+      continue;
+    }
+    lastSwitchReversed[s] = reversed;
+    for (int leg = 0; leg < 2; leg++) {
+      bool against = (leg == 1) != (reversed != 0);
+      for (int i = network.legBegin[2 * s + leg];
+           i < network.legBegin[2 * s + leg + 1]; i++) {
+        switchAgainst.Assign(network.legSegments[i], against);
+      }
+    }
+  }
+
+  for (int w = 0; w < occupied.WordCount(); w++) {
+    uint64_t occupiedWord = occupied.words[w];
+    uint64_t reservedWord = reserved.words[w];
+    uint64_t againstWord = switchAgainst.words[w];
+    uint64_t blockedWord = blocked.words[w];
+
+    uint64_t diff = (occupiedWord ^ lastOccupied.words[w]) |
+                    (reservedWord ^ lastReserved.words[w]) |
+                    (againstWord ^ lastSwitchAgainst.words[w]) |
+                    (blockedWord ^ lastBlocked.words[w]);
+    if (refreshAll) {
+      diff = ~(uint64_t)0;
+      if (w == occupied.WordCount() - 1 && (occupied.size & 63)) {
+        diff = ((uint64_t)1 << (occupied.size & 63)) - 1;
+      }
+    }
+    if (diff == 0) {
+      continue;
+    }
+
+    while (diff) {
+      int bit = LowestBit(diff);
+      diff &= diff - 1;
+      int state = (int)((occupiedWord >> bit) & 1) |
+                  (int)((reservedWord >> bit) & 1) << 1 |
+                  (int)((againstWord >> bit) & 1) << 2 |
+                  (int)((blockedWord >> bit) & 1) << 3;
+      int segment = w * 64 + bit;
+      if (colors[segment] != table[state]) {
+        colors[segment] = table[state];
+        changed.push_back(segment);
+      }
+    }
+
+    lastOccupied.words[w] = occupiedWord;
+    lastReserved.words[w] = reservedWord;
+    lastSwitchAgainst.words[w] = againstWord;
+    lastBlocked.words[w] = blockedWord;
+  }
+  refreshAll = false;
+  return (int)changed.size();
+}
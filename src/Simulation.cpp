@@ -0,0 +1,309 @@
+#include "Simulation.h"
+#include "Kinematics.h"
+#include "Trace.h"
+#include <algorithm>
+
+void Simulation::Reset(const TrackNetwork &network) {
+  fleet.Clear();
+  pool.Clear();
+  packed.clear();
+  occupancy.Resize(network.SegmentCount());
+  authority.Invalidate();
+  reachedEnd.clear();
+  occupancyChanges++;
+}
+
+int Simulation::Add(const TrackNetwork &network, int headSegment,
+                    float headOffset, int stockIndex, float trainLineSpeed) {
+  int train = fleet.Add(headSegment, headOffset);
+  pool.Add(train);
+  ImVec2 head = network.PointAt(headSegment, headOffset);
+  fleet.x[train] = head.x;
+  fleet.y[train] = head.y;
+  PackedTrain added;
+  added.tailSegment = headSegment;
+  added.SetLineSpeed(trainLineSpeed);
+  added.stock = (uint16_t)stockIndex;
+  packed.push_back(added);
+  return train;
+}
+
+void Simulation::Occupy(int train, const std::vector<int> &segments) {
+  // Occupancy expects the head on every segment it holds, tail first
+  for (size_t i = segments.size(); i-- > 0;) {
+    occupancy.Advance(train, segments[i], segments.back());
+  }
+  authority.Invalidate();
+  occupancyChanges++;
+}
+
+int Simulation::AddTrain(const TrackNetwork &network, int headSegment,
+                         float headOffset, float length, int stockIndex,
+                         float trainLineSpeed) {
+  int train = Add(network, headSegment, headOffset, stockIndex, trainLineSpeed);
+
+  // Follow the track back from the head, stopping at the start of track
+  placing.assign(1, headSegment);
+  float behind = length - headOffset;
+  float offset = headOffset - length;
+  while (behind > 0) {
+    int previous = network.PreviousSegment(placing.back());
+    if (previous < 0) {
+      offset = 0.0f;
+      break;
+    }
+    placing.push_back(previous);
+    offset = network.segmentLength[previous] - behind;
+    behind -= network.segmentLength[previous];
+  }
+  packed[train].tailSegment = placing.back();
+  fleet.tailOffset[train] = offset;
+  Occupy(train, placing);
+  return train;
+}
+
+int Simulation::PlaceTrain(const TrackNetwork &network, int headSegment,
+                           float headOffset, int backSegment, float backOffset,
+                           float trainSpeed, float trainAcceleration,
+                           int stockIndex, float trainLineSpeed) {
+  int train = Add(network, headSegment, headOffset, stockIndex, trainLineSpeed);
+  fleet.speed[train] = trainSpeed;
+  fleet.acceleration[train] = trainAcceleration;
+  packed[train].tailSegment = backSegment;
+  fleet.tailOffset[train] = backOffset;
+
+  // The head went ahead of the tail under the current switch positions, so
+  // follow them forward; failing that, trace back from the head
+  placing.assign(1, backSegment);
+  for (int steps = 0; placing.back() != headSegment; steps++) {
+    int next = network.NextSegment(placing.back());
+    if (next < 0 || steps == network.SegmentCount()) {
+      break;
+    }
+    placing.push_back(next);
+  }
+  if (placing.back() == headSegment) {
+    std::reverse(placing.begin(), placing.end());
+  } else {
+    placing.assign(1, headSegment);
+    while (placing.back() != backSegment &&
+           (int)placing.size() < network.SegmentCount()) {
+      int previous = network.PreviousSegment(placing.back());
+      if (previous < 0) {
+        break;
+      }
+      placing.push_back(previous);
+    }
+  }
+  Occupy(train, placing);
+  return train;
+}
+
+void Simulation::RemoveTrain(int train) {
+  int last = fleet.Count() - 1;
+  pool.Remove(train);
+  occupancy.Remove(train);
+  if (train != last) {
+    // Re-enter the last train's segments under its new index
+    placing.clear();
+    for (int node = occupancy.TailNode(last); node >= 0;
+         node = occupancy.NextTowardHead(node)) {
+      placing.push_back(occupancy.SegmentOf(node));
+    }
+    std::reverse(placing.begin(), placing.end());
+    occupancy.Remove(last);
+
+    fleet.segment[train] = fleet.segment[last];
+    fleet.offset[train] = fleet.offset[last];
+    fleet.x[train] = fleet.x[last];
+    fleet.y[train] = fleet.y[last];
+    fleet.speed[train] = fleet.speed[last];
+    fleet.acceleration[train] = fleet.acceleration[last];
+    fleet.targetSpeed[train] = fleet.targetSpeed[last];
+    fleet.tailOffset[train] = fleet.tailOffset[last];
+    packed[train] = packed[last];
+    Occupy(train, placing);
+  }
+
+  fleet.segment.pop_back();
+  fleet.offset.pop_back();
+  fleet.x.pop_back();
+  fleet.y.pop_back();
+  fleet.speed.pop_back();
+  fleet.acceleration.pop_back();
+  fleet.targetSpeed.pop_back();
+  fleet.tailOffset.pop_back();
+  packed.pop_back();
+  authority.Invalidate();
+  occupancyChanges++;
+}
+
+void Simulation::Capture(SimulationSnapshot *snapshot) const {
+  snapshot->fleet = fleet;
+  snapshot->packed = packed;
+  snapshot->reachedEnd = reachedEnd;
+  snapshot->pool = pool;
+  snapshot->stock = stock;
+  snapshot->maxLookahead = authority.maxLookahead;
+  snapshot->stoppingMargin = authority.stoppingMargin;
+
+  snapshot->trainSegments.clear();
+  snapshot->trainSegmentsBegin.assign(1, 0);
+  for (int train = 0; train < fleet.Count(); train++) {
+    size_t first = snapshot->trainSegments.size();
+    for (int node = occupancy.TailNode(train); node >= 0;
+         node = occupancy.NextTowardHead(node)) {
+      snapshot->trainSegments.push_back(occupancy.SegmentOf(node));
+    }
+    std::reverse(snapshot->trainSegments.begin() + first,
+                 snapshot->trainSegments.end());
+    snapshot->trainSegmentsBegin.push_back(
+        (int)snapshot->trainSegments.size());
+  }
+}
+
+void Simulation::Restore(const TrackNetwork &network,
+                         const SimulationSnapshot &snapshot) {
+  Reset(network);
+  fleet = snapshot.fleet;
+  packed = snapshot.packed;
+  reachedEnd = snapshot.reachedEnd;
+  pool = snapshot.pool;
+  stock = snapshot.stock;
+  authority.maxLookahead = snapshot.maxLookahead;
+  authority.stoppingMargin = snapshot.stoppingMargin;
+  for (int train = 0; train < fleet.Count(); train++) {
+    placing.assign(snapshot.trainSegments.begin() +
+                       snapshot.trainSegmentsBegin[train],
+                   snapshot.trainSegments.begin() +
+                       snapshot.trainSegmentsBegin[train + 1]);
+    Occupy(train, placing);
+  }
+}
+
+void Simulation::AddMemoryUsage(MemoryUsage *usage) const {
+  fleet.AddMemoryUsage(usage);
+  pool.AddMemoryUsage(usage);
+  usage->Add(stock);
+  usage->Add(packed);
+  occupancy.AddMemoryUsage(usage);
+  authority.AddMemoryUsage(usage);
+  usage->Add(reachedEnd);
+  for (const Arena &arena : arenas) {
+    usage->Add(arena.Capacity());
+  }
+  usage->Add(placing);
+}
+
+void Simulation::StepChunk(const TrackNetwork &network, float dt, int chunk,
+                           Arena *arena, ChunkCrossings *crossings) {
+  TRACE_SCOPE("Simulation::StepChunk");
+  int begin = chunk * chunkSize;
+  int end = std::min(begin + chunkSize, fleet.Count());
+
+  for (int i = begin; i < end; i++) {
+    fleet.targetSpeed[i] =
+        std::min(packed[i].LineSpeed(), authority.speedLimit[i]);
+  }
+  StepDynamics(&fleet, packed.data(), stock, dt, begin, end);
+  crossings->heads = arena->Allocate<int>(end - begin);
+  crossings->headCount =
+      UpdateKinematics(&fleet, network, dt, begin, end, crossings->heads);
+
+  // Tails run the same distance as heads and only ever follow them, so
+  // they take the switch positions the heads already took
+  crossings->tails = arena->Allocate<int>(end - begin);
+  crossings->tailCount = 0;
+  const float halfDtSquared = 0.5f * dt * dt;
+  for (int i = begin; i < end; i++) {
+    float offset = fleet.tailOffset[i] + fleet.speed[i] * dt -
+                   fleet.acceleration[i] * halfDtSquared;
+    int segment = packed[i].tailSegment;
+    bool changed = false;
+    while (offset >= network.segmentLength[segment]) {
+      int next = network.NextSegment(segment);
+      if (next < 0) {
+        offset = network.segmentLength[segment];
+        break;
+      }
+      offset -= network.segmentLength[segment];
+      segment = next;
+      changed = true;
+    }
+    fleet.tailOffset[i] = offset;
+    packed[i].tailSegment = segment;
+    if (changed) {
+      crossings->tails[crossings->tailCount++] = i;
+    }
+  }
+}
+
+void Simulation::Step(const TrackNetwork &network, const BitSet *occupied,
+                      const BitSet *reserved, const HeadwayMonitor *intervals,
+                      float dt, JobSystem *jobs) {
+  reachedEnd.clear();
+  if (++ticksSinceCompact >= compactInterval) {
+    pool.Compact();
+    ticksSinceCompact = 0;
+  }
+  if (fleet.Count() == 0) {
+    return;
+  }
+  // Nothing from the last tick's arenas is still in use
+  size_t threadCount = jobs ? jobs->ThreadCount() : 1;
+  if (arenas.size() < threadCount) {
+    arenas.resize(threadCount);
+  }
+  for (Arena &arena : arenas) {
+    arena.Reset();
+  }
+  Arena &arena = arenas[jobs ? jobs->ThreadIndex() : 0];
+
+  authority.Compute(network, occupied ? *occupied : occupancy.occupied,
+                    reserved, intervals, fleet, packed.data(), stock,
+                    &arena);
+
+  int chunkCount = (fleet.Count() + chunkSize - 1) / chunkSize;
+  ChunkCrossings *chunks = arena.Allocate<ChunkCrossings>(chunkCount);
+  if (jobs) {
+    jobs->ParallelFor(0, chunkCount, 1, [&](int begin, int end) {
+      Arena *own = &arenas[jobs->ThreadIndex()];
+      for (int chunk = begin; chunk < end; chunk++) {
+        StepChunk(network, dt, chunk, own, &chunks[chunk]);
+      }
+    });
+  } else {
+    for (int chunk = 0; chunk < chunkCount; chunk++) {
+      StepChunk(network, dt, chunk, &arena, &chunks[chunk]);
+    }
+  }
+
+  // Chunks are in train order, so the merged lists are too
+  ArenaAllocator<int> scratch(&arena);
+  ArenaVector<int> crossed(scratch);
+  ArenaVector<int> tailsCrossed(scratch);
+  for (int chunk = 0; chunk < chunkCount; chunk++) {
+    const ChunkCrossings &crossings = chunks[chunk];
+    crossed.insert(crossed.end(), crossings.heads,
+                   crossings.heads + crossings.headCount);
+    tailsCrossed.insert(tailsCrossed.end(), crossings.tails,
+                        crossings.tails + crossings.tailCount);
+  }
+  CrossSegments(&fleet, network, crossed.data(), (int)crossed.size(),
+                &reachedEnd);
+
+  if (crossed.empty() && tailsCrossed.empty()) {
+    return;
+  }
+  ArenaVector<int> moved(crossed.size() + tailsCrossed.size(), 0, scratch);
+  ArenaVector<int>::iterator movedEnd =
+      std::merge(crossed.begin(), crossed.end(), tailsCrossed.begin(),
+                 tailsCrossed.end(), moved.begin());
+  moved.erase(std::unique(moved.begin(), movedEnd), moved.end());
+  for (int train : moved) {
+    occupancy.Advance(train, fleet.segment[train],
+                      packed[train].tailSegment);
+  }
+  authority.Invalidate();
+  occupancyChanges++;
+}
@@ -0,0 +1,701 @@
+#include "SimulationPartition.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <queue>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+SimulationPartition::SimulationPartition(
+    const TrackNetwork &network, const std::vector<int> &regionOfSegment,
+    int self, const std::vector<StockTables> &stock, float dt)
+    : network(network), segmentRegion(regionOfSegment), self(self), dt(dt) {
+  listenPath[0] = '\0';
+  simulation.stock = stock;
+  simulation.Reset(network);
+  handedOver.Resize(network.SegmentCount());
+  occupied.Resize(network.SegmentCount());
+
+  for (const StockTables &table : stock) {
+    topSpeed = std::max(topSpeed,
+                        table.speedStep * (StockTables::sampleCount - 1));
+  }
+
+  int partitionCount = 0;
+  for (int region : segmentRegion) {
+    partitionCount = std::max(partitionCount, region + 1);
+  }
+
+  // Predecessors over every switch leg, for walking distances backward
+  std::vector<int> counts(network.SegmentCount() + 1, 0);
+  for (int segment = 0; segment < network.SegmentCount(); segment++) {
+    int switchIndex = network.segmentSwitch[segment];
+    if (switchIndex >= 0) {
+      counts[network.switchNormal[switchIndex] + 1]++;
+      counts[network.switchReverse[switchIndex] + 1]++;
+    } else if (network.segmentNext[segment] >= 0) {
+      counts[network.segmentNext[segment] + 1]++;
+    }
+  }
+  for (int segment = 0; segment < network.SegmentCount(); segment++) {
+    counts[segment + 1] += counts[segment];
+  }
+  predecessorBegin = counts;
+  predecessors.resize(counts.back());
+  for (int segment = 0; segment < network.SegmentCount(); segment++) {
+    int switchIndex = network.segmentSwitch[segment];
+    if (switchIndex >= 0) {
+      predecessors[counts[network.switchNormal[switchIndex]]++] = segment;
+      predecessors[counts[network.switchReverse[switchIndex]]++] = segment;
+    } else if (network.segmentNext[segment] >= 0) {
+      predecessors[counts[network.segmentNext[segment]]++] = segment;
+    }
+  }
+
+  neighbours.resize(partitionCount);
+  for (int partition = 0; partition < partitionCount; partition++) {
+    if (partition != self) {
+      neighbours[partition].occupied.Resize(network.SegmentCount());
+      BuildInterest(partition);
+      BuildDistance(partition);
+      BuildEntryTicks(partition);
+    }
+  }
+}
+
+SimulationPartition::~SimulationPartition() {
+  for (Neighbour &neighbour : neighbours) {
+    if (neighbour.fd >= 0) {
+      close(neighbour.fd);
+    }
+  }
+  if (listenFd >= 0) {
+    close(listenFd);
+    unlink(listenPath);
+  }
+}
+
+typedef std::pair<float, int> DistanceEntry;
+typedef std::priority_queue<DistanceEntry, std::vector<DistanceEntry>,
+                            std::greater<DistanceEntry>>
+    DistanceQueue;
+
+void SimulationPartition::BuildInterest(int partition) {
+  // The partition sees its own segments, and every segment starting within
+  // movement authority look-ahead of the end of one of them
+  const float limit = simulation.authority.maxLookahead;
+  std::vector<float> distance(network.SegmentCount(), INFINITY);
+  DistanceQueue open;
+  for (int segment = 0; segment < network.SegmentCount(); segment++) {
+    if (segmentRegion[segment] == partition) {
+      distance[segment] = -1.0f;
+      open.push(DistanceEntry(-1.0f, segment));
+    }
+  }
+  while (!open.empty()) {
+    DistanceEntry entry = open.top();
+    open.pop();
+    int segment = entry.second;
+    if (entry.first > distance[segment]) {
+      continue;
+    }
+    // Sources start the count at their end
+    float beyond = entry.first < 0.0f
+                       ? 0.0f
+                       : entry.first + network.segmentLength[segment];
+    int switchIndex = network.segmentSwitch[segment];
+    int legs[2] = {network.segmentNext[segment], -1};
+    if (switchIndex >= 0) {
+      legs[0] = network.switchNormal[switchIndex];
+      legs[1] = network.switchReverse[switchIndex];
+    }
+    for (int next : legs) {
+      if (next >= 0 && beyond <= limit && beyond < distance[next]) {
+        distance[next] = beyond;
+        open.push(DistanceEntry(beyond, next));
+      }
+    }
+  }
+
+  Neighbour &neighbour = neighbours[partition];
+  BitSet interest;
+  interest.Resize(network.SegmentCount());
+  for (int segment = 0; segment < network.SegmentCount(); segment++) {
+    if (distance[segment] <= limit) {
+      interest.Set(segment);
+    }
+  }
+  for (int word = 0; word < interest.WordCount(); word++) {
+    if (interest.words[word] != 0) {
+      neighbour.interestWords.push_back(word);
+      neighbour.interestMasks.push_back(interest.words[word]);
+    }
+  }
+  neighbour.lastSent.assign(neighbour.interestWords.size(), 0);
+
+  // Seen segments are distance zero for BuildDistance
+  neighbour.distance.assign(network.SegmentCount(), INFINITY);
+  for (int segment = 0; segment < network.SegmentCount(); segment++) {
+    if (interest.Test(segment)) {
+      neighbour.distance[segment] = 0.0f;
+    }
+  }
+}
+
+void SimulationPartition::BuildDistance(int partition) {
+  // From the end of each segment to the start of the nearest segment the
+  // partition sees, walking back from those segments
+  std::vector<float> &distance = neighbours[partition].distance;
+  std::vector<unsigned char> seen(network.SegmentCount(), 0);
+  DistanceQueue open;
+  for (int segment = 0; segment < network.SegmentCount(); segment++) {
+    if (distance[segment] == 0.0f) {
+      seen[segment] = 1;
+      open.push(DistanceEntry(0.0f, segment));
+    }
+  }
+  std::vector<float> beyond(network.SegmentCount(), INFINITY);
+  while (!open.empty()) {
+    DistanceEntry entry = open.top();
+    open.pop();
+    int segment = entry.second;
+    float length = network.segmentLength[segment];
+    float reached = seen[segment] ? 0.0f : entry.first + length;
+    if (!seen[segment] && entry.first > beyond[segment]) {
+      continue;
+    }
+    for (int i = predecessorBegin[segment]; i < predecessorBegin[segment + 1];
+         i++) {
+      int previous = predecessors[i];
+      if (!seen[previous] && reached < beyond[previous]) {
+        beyond[previous] = reached;
+        open.push(DistanceEntry(reached, previous));
+      }
+    }
+  }
+  for (int segment = 0; segment < network.SegmentCount(); segment++) {
+    if (!seen[segment]) {
+      distance[segment] = beyond[segment];
+    }
+  }
+}
+
+void SimulationPartition::BuildEntryTicks(int partition) {
+  // A train handed over can have its head anywhere in the first tick's run
+  // past a boundary, and accelerate no higher than the top speed allows
+  Neighbour &neighbour = neighbours[partition];
+  float nearest = INFINITY;
+  for (int segment = 0; segment < network.SegmentCount(); segment++) {
+    if (segmentRegion[segment] != self) {
+      continue;
+    }
+    for (int i = predecessorBegin[segment]; i < predecessorBegin[segment + 1];
+         i++) {
+      if (segmentRegion[predecessors[i]] != self) {
+        nearest = std::min(nearest, neighbour.distance[segment]);
+      }
+    }
+  }
+  float fastest = topSpeed * 1.05f * dt;
+  float ticks = fastest > 0.0f ? floorf(nearest / fastest) - 2.0f : 0.0f;
+  neighbour.entryTicks =
+      ticks < 0.0f ? 0 : (int)std::min(ticks, (float)(INT_MAX / 4));
+}
+
+int SimulationPartition::TicksUntilSeen(int partition, int segment,
+                                        float offset, float speed,
+                                        float trainLineSpeed) const {
+  const std::vector<float> &distance = neighbours[partition].distance;
+  if (distance[segment] == 0.0f) {
+    return 0;
+  }
+  // Trains never run faster than their line speed or their current speed
+  float fastest = std::max(speed, trainLineSpeed) * dt;
+  if (fastest <= 0.0f) {
+    return INT_MAX / 2;
+  }
+  float ahead = network.segmentLength[segment] - offset + distance[segment];
+  float ticks = floorf(ahead / fastest) - 1.0f;
+  return ticks < 0.0f ? 0 : (int)std::min(ticks, (float)(INT_MAX / 2));
+}
+
+bool SimulationPartition::HoldsSeen(int partition, int tailSegment,
+                                    int headSegment) const {
+  // Tails follow heads under the current switch positions
+  const std::vector<float> &distance = neighbours[partition].distance;
+  int segment = tailSegment;
+  for (int steps = 0; segment >= 0 && steps < network.SegmentCount();
+       steps++) {
+    if (distance[segment] == 0.0f) {
+      return true;
+    }
+    if (segment == headSegment) {
+      return false;
+    }
+    segment = network.NextSegment(segment);
+  }
+  return false;
+}
+
+bool SimulationPartition::AddTrain(int id, int headSegment, float headOffset,
+                                   float length, int stockIndex,
+                                   float trainLineSpeed) {
+  if (segmentRegion[headSegment] != self) {
+    return false;
+  }
+  SetTrainId(simulation.AddTrain(network, headSegment, headOffset, length,
+                                  stockIndex, trainLineSpeed),
+             id);
+  return true;
+}
+
+void SimulationPartition::SetTrainId(int train, int id) {
+  // The pool only outgrows slotId while the fleet does
+  slotId.resize(simulation.pool.SlotCount());
+  slotId[simulation.Handle(train).slot] = id;
+}
+
+// Reads all of a message from a blocking socket, however it was split
+static bool ReadMessage(int fd, PartitionMessage *message) {
+  char *bytes = (char *)message;
+  size_t remaining = sizeof(*message);
+  while (remaining > 0) {
+    ssize_t received = read(fd, bytes, remaining);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    bytes += received;
+    remaining -= received;
+  }
+  return true;
+}
+
+static bool WriteMessage(int fd, const PartitionMessage &message) {
+  const char *bytes = (const char *)&message;
+  size_t remaining = sizeof(message);
+  while (remaining > 0) {
+    ssize_t sent = write(fd, bytes, remaining);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    bytes += sent;
+    remaining -= sent;
+  }
+  return true;
+}
+
+static bool SetAddress(sockaddr_un *address, const char *directory,
+                       int partition) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  int written = snprintf(address->sun_path, sizeof(address->sun_path),
+                         "%s/partition-%d.sock", directory, partition);
+  return written > 0 && written < (int)sizeof(address->sun_path);
+}
+
+bool SimulationPartition::Connect(const char *directory) {
+  sockaddr_un address;
+  if (!SetAddress(&address, directory, self)) {
+    return false;
+  }
+  snprintf(listenPath, sizeof(listenPath), "%s", address.sun_path);
+  unlink(listenPath);
+  listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenFd < 0 || bind(listenFd, (sockaddr *)&address, sizeof(address)) ||
+      listen(listenFd, (int)neighbours.size())) {
+    return false;
+  }
+
+  // Connect to lower partitions, retrying until they are listening, and
+  // accept the higher ones
+  PartitionMessage hello;
+  memset(&hello, 0, sizeof(hello));
+  hello.type = PartitionMessage_Hello;
+  hello.from = self;
+  for (int partition = 0; partition < self; partition++) {
+    if (!SetAddress(&address, directory, partition)) {
+      return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int attempt = 0;
+    while (fd >= 0 && connect(fd, (sockaddr *)&address, sizeof(address))) {
+      if (++attempt == 1000) {
+        return false;
+      }
+      usleep(10000);
+    }
+    if (fd < 0 || !WriteMessage(fd, hello)) {
+      return false;
+    }
+    neighbours[partition].fd = fd;
+  }
+  for (int accepted = self + 1; accepted < (int)neighbours.size();
+       accepted++) {
+    int fd = accept(listenFd, nullptr, nullptr);
+    PartitionMessage message;
+    if (fd < 0 || !ReadMessage(fd, &message) ||
+        message.type != PartitionMessage_Hello || message.from <= self ||
+        message.from >= (int)neighbours.size()) {
+      return false;
+    }
+    neighbours[message.from].fd = fd;
+  }
+
+  for (Neighbour &neighbour : neighbours) {
+    if (neighbour.fd >= 0) {
+      fcntl(neighbour.fd, F_SETFL, fcntl(neighbour.fd, F_GETFL) | O_NONBLOCK);
+    }
+  }
+  return true;
+}
+
+void SimulationPartition::Send(int partition, const PartitionMessage &message) {
+  std::vector<char> &outbox = neighbours[partition].outbox;
+  const char *bytes = (const char *)&message;
+  outbox.insert(outbox.end(), bytes, bytes + sizeof(message));
+}
+
+bool SimulationPartition::Flush(int partition) {
+  Neighbour &neighbour = neighbours[partition];
+  while (neighbour.outboxSent < neighbour.outbox.size()) {
+    ssize_t sent = send(neighbour.fd, neighbour.outbox.data() +
+                                          neighbour.outboxSent,
+                        neighbour.outbox.size() - neighbour.outboxSent,
+                        MSG_NOSIGNAL);
+    if (sent < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    neighbour.outboxSent += sent;
+  }
+  neighbour.outbox.clear();
+  neighbour.outboxSent = 0;
+  return true;
+}
+
+bool SimulationPartition::Receive(int partition) {
+  Neighbour &neighbour = neighbours[partition];
+  char buffer[1 << 16];
+  bool closed = false;
+  for (;;) {
+    ssize_t received = recv(neighbour.fd, buffer, sizeof(buffer), 0);
+    if (received == 0) {
+      closed = true;
+      break;
+    }
+    if (received < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        break;
+      }
+      return false;
+    }
+    neighbour.inbox.insert(neighbour.inbox.end(), buffer, buffer + received);
+  }
+
+  // Streams keep order, so a horizon arrives after everything it covers
+  size_t used = 0;
+  PartitionMessage message;
+  for (; used + sizeof(message) <= neighbour.inbox.size();
+       used += sizeof(message)) {
+    memcpy(&message, neighbour.inbox.data() + used, sizeof(message));
+    if (message.type == PartitionMessage_Horizon) {
+      neighbour.horizon = std::max(neighbour.horizon, message.tick);
+    } else {
+      pending.push_back(message);
+    }
+  }
+  neighbour.inbox.erase(neighbour.inbox.begin(),
+                        neighbour.inbox.begin() + used);
+  if (closed) {
+    // Only expected once the neighbour has promised nothing more
+    close(neighbour.fd);
+    neighbour.fd = -1;
+    return neighbour.horizon == INT_MAX;
+  }
+  return true;
+}
+
+bool SimulationPartition::Pump(bool block) {
+  std::vector<pollfd> fds;
+  std::vector<int> partitions;
+  for (int partition = 0; partition < (int)neighbours.size(); partition++) {
+    Neighbour &neighbour = neighbours[partition];
+    if (neighbour.fd < 0) {
+      continue;
+    }
+    if (!Flush(partition)) {
+      return false;
+    }
+    pollfd fd;
+    fd.fd = neighbour.fd;
+    fd.events = neighbour.outbox.empty() ? POLLIN : POLLIN | POLLOUT;
+    fd.revents = 0;
+    fds.push_back(fd);
+    partitions.push_back(partition);
+  }
+  if (fds.empty()) {
+    return true;
+  }
+  if (poll(fds.data(), fds.size(), block ? 1000 : 0) < 0) {
+    return errno == EINTR;
+  }
+  for (size_t i = 0; i < fds.size(); i++) {
+    if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) &&
+        !Receive(partitions[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void SimulationPartition::Apply() {
+  // Take the messages due by this tick, keeping arrival order
+  std::stable_sort(pending.begin(), pending.end(),
+                   [](const PartitionMessage &a, const PartitionMessage &b) {
+                     return a.tick < b.tick;
+                   });
+  size_t due = 0;
+  for (; due < pending.size() && pending[due].tick <= tick; due++) {
+    const PartitionMessage &message = pending[due];
+    if (message.type == PartitionMessage_Occupancy) {
+      neighbours[message.from].occupied.words[message.word] = message.bits;
+    } else if (message.type == PartitionMessage_Handoff) {
+      const TrainHandoff &train = message.train;
+      SetTrainId(simulation.PlaceTrain(network, train.headSegment,
+                                       train.headOffset, train.tailSegment,
+                                       train.tailOffset, train.speed,
+                                       train.acceleration, train.stock,
+                                       train.lineSpeed),
+                 train.id);
+    }
+  }
+  pending.erase(pending.begin(), pending.begin() + due);
+
+  // Everything this partition's trains must respect: its own trains, what
+  // the neighbours last reported and trains it has just handed over
+  bool changed = false;
+  for (int word = 0; word < occupied.WordCount(); word++) {
+    uint64_t bits = simulation.occupancy.occupied.words[word] |
+                    handedOver.words[word];
+    for (int partition = 0; partition < (int)neighbours.size(); partition++) {
+      if (partition != self) {
+        bits |= neighbours[partition].occupied.words[word];
+      }
+    }
+    changed |= bits != occupied.words[word];
+    occupied.words[word] = bits;
+  }
+  if (changed) {
+    simulation.authority.Invalidate();
+  }
+}
+
+void SimulationPartition::HandOver() {
+  // Handed-over trains stay visible here for the one tick before their new
+  // partition reports them
+  for (int segment : handedSegments) {
+    handedOver.Reset(segment);
+  }
+  handedSegments.clear();
+
+  TrainFleet &fleet = simulation.fleet;
+  for (int i = fleet.Count() - 1; i >= 0; i--) {
+    int to = segmentRegion[fleet.segment[i]];
+    if (to == self) {
+      continue;
+    }
+    PartitionMessage message;
+    memset(&message, 0, sizeof(message));
+    message.type = PartitionMessage_Handoff;
+    message.from = self;
+    message.tick = tick + 1;
+    TrainHandoff &train = message.train;
+    train.id = TrainId(i);
+    train.headSegment = fleet.segment[i];
+    train.headOffset = fleet.offset[i];
+    train.tailSegment = simulation.packed[i].tailSegment;
+    train.tailOffset = fleet.tailOffset[i];
+    train.speed = fleet.speed[i];
+    train.acceleration = fleet.acceleration[i];
+    train.stock = simulation.packed[i].stock;
+    train.lineSpeed = simulation.packed[i].LineSpeed();
+    Send(to, message);
+    handoffsSent++;
+
+    const Occupancy &occupancy = simulation.occupancy;
+    for (int node = occupancy.TailNode(i); node >= 0;
+         node = occupancy.NextTowardHead(node)) {
+      handedOver.Set(occupancy.SegmentOf(node));
+      handedSegments.push_back(occupancy.SegmentOf(node));
+    }
+    simulation.RemoveTrain(i);
+  }
+}
+
+void SimulationPartition::ReportOccupancy() {
+  const BitSet &own = simulation.occupancy.occupied;
+  for (int partition = 0; partition < (int)neighbours.size(); partition++) {
+    Neighbour &neighbour = neighbours[partition];
+    if (partition == self) {
+      continue;
+    }
+    // Changes are only possible where trains stood or could reach, which
+    // the promised horizon already held the neighbour back for
+    for (size_t i = 0; i < neighbour.interestWords.size(); i++) {
+      uint64_t bits = own.words[neighbour.interestWords[i]] &
+                      neighbour.interestMasks[i];
+      if (bits == neighbour.lastSent[i]) {
+        continue;
+      }
+      PartitionMessage message;
+      memset(&message, 0, sizeof(message));
+      message.type = PartitionMessage_Occupancy;
+      message.from = self;
+      message.tick = tick + 1;
+      message.word = neighbour.interestWords[i];
+      message.bits = bits;
+      Send(partition, message);
+      neighbour.lastSent[i] = bits;
+    }
+  }
+}
+
+void SimulationPartition::PromiseHorizons() {
+  // Trains not yet handed over arrive no earlier than their sender's
+  // horizon, and take a while to come into view
+  int adoption = INT_MAX;
+  for (int partition = 0; partition < (int)neighbours.size(); partition++) {
+    if (partition != self && neighbours[partition].horizon != INT_MAX) {
+      adoption = std::min(adoption, neighbours[partition].horizon);
+    }
+  }
+
+  // The coming step's changes are reported for the tick after it
+  const TrainFleet &fleet = simulation.fleet;
+  for (int partition = 0; partition < (int)neighbours.size(); partition++) {
+    Neighbour &neighbour = neighbours[partition];
+    if (partition == self) {
+      continue;
+    }
+    // Partitions with no trains raise each other's horizons, so keep them
+    // short of INT_MAX, which means finished
+    int horizon = INT_MAX;
+    if (adoption != INT_MAX) {
+      long long seen = (long long)adoption + neighbour.entryTicks + 1;
+      horizon = (int)std::min(seen, (long long)INT_MAX - 1);
+    }
+    // A train standing where the neighbour sees may free a segment on the
+    // next step
+    for (int i = 0; i < fleet.Count() && horizon > tick + 1; i++) {
+      int ticks =
+          HoldsSeen(partition, simulation.packed[i].tailSegment,
+                    fleet.segment[i])
+              ? 0
+              : TicksUntilSeen(partition, fleet.segment[i], fleet.offset[i],
+                               fleet.speed[i],
+                               simulation.packed[i].LineSpeed());
+      horizon = std::min(horizon, tick + ticks + 1);
+    }
+    for (const PartitionMessage &message : pending) {
+      if (message.type == PartitionMessage_Handoff) {
+        const TrainHandoff &train = message.train;
+        int ticks =
+            HoldsSeen(partition, train.tailSegment, train.headSegment)
+                ? 0
+                : TicksUntilSeen(partition, train.headSegment,
+                                 train.headOffset, train.speed,
+                                 train.lineSpeed);
+        horizon = std::min(horizon, std::max(message.tick, tick) + ticks + 1);
+      }
+    }
+    if (horizon > neighbour.promised) {
+      PartitionMessage message;
+      memset(&message, 0, sizeof(message));
+      message.type = PartitionMessage_Horizon;
+      message.from = self;
+      message.tick = horizon;
+      Send(partition, message);
+      neighbour.promised = horizon;
+      nullMessagesSent++;
+    }
+  }
+}
+
+bool SimulationPartition::Run(int endTick) {
+  PromiseHorizons();
+  for (;;) {
+    // Wait until every neighbour has sent everything due by this tick, and
+    // at the end take in trains handed over on the last step
+    bool waited = false;
+    for (;;) {
+      if (!Pump(false)) {
+        return false;
+      }
+      bool ready = true;
+      for (int partition = 0; partition < (int)neighbours.size();
+           partition++) {
+        if (partition != self && neighbours[partition].horizon <= tick) {
+          ready = false;
+        }
+      }
+      if (ready) {
+        break;
+      }
+      waited = true;
+      if (!Pump(true)) {
+        return false;
+      }
+    }
+    Apply();
+    if (tick >= endTick) {
+      return true;
+    }
+    waits += waited ? 1 : 0;
+    simulation.Step(network, &occupied, nullptr, nullptr, dt, nullptr);
+    HandOver();
+    ReportOccupancy();
+    tick++;
+    PromiseHorizons();
+  }
+}
+
+bool SimulationPartition::Finish() {
+  for (int partition = 0; partition < (int)neighbours.size(); partition++) {
+    if (partition != self) {
+      PartitionMessage message;
+      memset(&message, 0, sizeof(message));
+      message.type = PartitionMessage_Horizon;
+      message.from = self;
+      message.tick = INT_MAX;
+      Send(partition, message);
+      neighbours[partition].promised = INT_MAX;
+    }
+  }
+  for (;;) {
+    bool done = true;
+    for (int partition = 0; partition < (int)neighbours.size(); partition++) {
+      const Neighbour &neighbour = neighbours[partition];
+      if (partition != self &&
+          (neighbour.horizon != INT_MAX || !neighbour.outbox.empty())) {
+        done = false;
+      }
+    }
+    if (done) {
+      return true;
+    }
+    if (!Pump(true)) {
+      return false;
+    }
+  }
+}
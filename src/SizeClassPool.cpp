@@ -0,0 +1,77 @@
+#include "SizeClassPool.h"
+#include <stdlib.h>
+
+static const size_t smallestClassSize = 32;
+static const size_t slabSize = 64 * 1024;
+
+SizeClassPool::~SizeClassPool() {
+  for (SizeClass &sizeClass : classes) {
+    for (char *slab : sizeClass.slabs) {
+      free(slab);
+    }
+  }
+}
+
+void *SizeClassPool::Allocate(size_t size) {
+  size_t needed = sizeof(Header) + size;
+  int index = 0;
+  while (index < classCount && smallestClassSize << index < needed) {
+    index++;
+  }
+
+  Header *header;
+  if (index == classCount) {
+    header = (Header *)malloc(needed);
+    if (!header) {
+      return nullptr;
+    }
+    reservedBytes += needed;
+  } else {
+    SizeClass &sizeClass = classes[index];
+    size_t blockSize = smallestClassSize << index;
+    std::lock_guard<std::mutex> lock(sizeClass.mutex);
+    if (sizeClass.free) {
+      header = (Header *)sizeClass.free;
+      sizeClass.free = sizeClass.free->next;
+    } else {
+      if (sizeClass.unusedBytes < blockSize) {
+        char *slab = (char *)malloc(slabSize);
+        if (!slab) {
+          return nullptr;
+        }
+        sizeClass.slabs.push_back(slab);
+        sizeClass.unused = slab;
+        sizeClass.unusedBytes = slabSize;
+        reservedBytes += slabSize;
+      }
+      header = (Header *)sizeClass.unused;
+      sizeClass.unused += blockSize;
+      sizeClass.unusedBytes -= blockSize;
+    }
+  }
+  header->size = size;
+  header->sizeClass = index;
+  liveBytes += size;
+  liveBlocks++;
+  allocations++;
+  return header + 1;
+}
+
+void SizeClassPool::Free(void *block) {
+  if (!block) {
+    return;
+  }
+  Header *header = (Header *)block - 1;
+  liveBytes -= header->size;
+  liveBlocks--;
+  if (header->sizeClass == classCount) {
+    reservedBytes -= sizeof(Header) + header->size;
+    free(header);
+    return;
+  }
+  SizeClass &sizeClass = classes[header->sizeClass];
+  std::lock_guard<std::mutex> lock(sizeClass.mutex);
+  FreeBlock *freed = (FreeBlock *)header;
+  freed->next = sizeClass.free;
+  sizeClass.free = freed;
+}
@@ -0,0 +1,656 @@
+#include "Timetable.h"
+#include <algorithm>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_map>
+
+// Read this much of a file at a time; a single row longer than this grows
+// the buffer
+static const size_t blockSize = 1 << 20;
+
+int DayNumber(int year, int month, int day) {
+  // Days from 0000-03-01, so leap days fall at the end of each year
+  year -= month <= 2;
+  int era = (year >= 0 ? year : year - 399) / 400;
+  int yearOfEra = year - era * 400;
+  int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int dayOfEra =
+      yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + dayOfEra - 719468;
+}
+
+int Weekday(int dayNumber) {
+  // 1970-01-01 was a Thursday
+  return ((dayNumber + 3) % 7 + 7) % 7;
+}
+
+bool Timetable::Runs(int trip, int day) const {
+  int service = tripService[trip];
+  long long date = (long long)service << 32 | (unsigned)day;
+  if (std::binary_search(removedDates.begin(), removedDates.end(), date)) {
+    return false;
+  }
+  if (std::binary_search(addedDates.begin(), addedDates.end(), date)) {
+    return true;
+  }
+  return day >= serviceFirstDay[service] && day <= serviceLastDay[service] &&
+         (serviceWeekdays[service] >> Weekday(day) & 1) != 0;
+}
+
+void Timetable::DeparturesBetween(long long from, long long to, int *first,
+                                  int *last) const {
+  long long end = (long long)firstAt.size() - 1;
+  from = std::min(std::max(from, 0LL), end);
+  to = std::min(std::max(to, from), end);
+  *first = firstAt[from];
+  *last = firstAt[to];
+}
+
+struct CsvField {
+  const char *text;
+  int length;
+};
+
+// Reads a CSV file a row at a time, splitting each row in place. Quoted
+// fields may hold commas, newlines and doubled quotes; a leading UTF-8 byte
+// order mark and carriage returns are dropped.
+class CsvReader {
+public:
+  ~CsvReader() {
+    if (in) {
+      fclose(in);
+    }
+  }
+
+  bool Open(const char *path) {
+    in = fopen(path, "rb");
+    return in != nullptr;
+  }
+  // False at the end of the file, or if it cannot be read
+  bool NextRow();
+  bool Failed() const { return in && ferror(in); }
+
+  int FieldCount() const { return (int)fields.size(); }
+  CsvField Field(int i) const {
+    return i >= 0 && i < FieldCount() ? fields[i] : CsvField{"", 0};
+  }
+  long long Line() const { return line; }
+  // Index of the header's column, or -1
+  int Column(const char *name) const;
+
+private:
+  FILE *in = nullptr;
+  std::vector<char> buffer;
+  size_t position = 0;
+  size_t filled = 0;
+  bool atEnd = false;
+  long long line = 0;     // Of the current row
+  long long nextLine = 1; // Of the row after it
+  std::vector<CsvField> fields;
+  std::vector<std::string> header;
+
+  bool Fill();
+  void Split(char *begin, char *end);
+};
+
+bool CsvReader::Fill() {
+  if (atEnd) {
+    return false;
+  }
+  filled -= position;
+  if (buffer.size() < filled + blockSize) {
+    buffer.resize(filled + blockSize);
+  }
+  memmove(buffer.data(), buffer.data() + position, filled);
+  position = 0;
+  size_t read = fread(buffer.data() + filled, 1, blockSize, in);
+  filled += read;
+  atEnd = read < blockSize;
+  return true;
+}
+
+// Splits a row into fields, removing the quoting in place
+void CsvReader::Split(char *begin, char *end) {
+  fields.clear();
+  char *p = begin;
+  while (end > begin && end[-1] == '\r') {
+    end--;
+  }
+  for (;;) {
+    char *field = p;
+    char *out = p;
+    if (p < end && *p == '"') {
+      for (p++; p < end; p++) {
+        if (*p == '"') {
+          if (p + 1 < end && p[1] == '"') {
+            p++;
+          } else {
+            p++;
+            break;
+          }
+        }
+        *out++ = *p;
+      }
+      while (p < end && *p != ',') {
+        *out++ = *p++;
+      }
+    } else {
+      p = (char *)memchr(p, ',', end - p);
+      p = p ? p : end;
+      out = p;
+    }
+    fields.push_back(CsvField{field, (int)(out - field)});
+    if (p == end) {
+      break;
+    }
+    p++;
+  }
+}
+
+bool CsvReader::NextRow() {
+  for (;;) {
+    // A row ends at the first newline outside quotes
+    char *base = buffer.data();
+    char *row = base + position;
+    char *last = base + filled;
+    char *end = row < last ? (char *)memchr(row, '\n', last - row) : nullptr;
+    long long newlines = end != nullptr;
+    if (end && memchr(row, '"', end - row)) {
+      // Quoted fields may hold newlines, so go a character at a time
+      end = nullptr;
+      newlines = 0;
+      bool quoted = false;
+      for (char *p = row; p < last; p++) {
+        quoted ^= *p == '"';
+        if (*p == '\n') {
+          newlines++;
+          if (!quoted) {
+            end = p;
+            break;
+          }
+        }
+      }
+    }
+    if (!end && !atEnd) {
+      Fill();
+      continue;
+    }
+    if (!end && row == last) {
+      return false;
+    }
+    end = end ? end : last;
+    line = nextLine;
+    nextLine += newlines;
+    position = (size_t)(end - base) + (end < last);
+    if (line == 1 && end - row >= 3 && memcmp(row, "\xEF\xBB\xBF", 3) == 0) {
+      row += 3;
+    }
+    Split(row, end);
+    if (line > 1 && fields.size() == 1 && fields[0].length == 0) {
+      continue; // Blank line
+    }
+    if (line == 1) {
+      header.clear();
+      for (const CsvField &field : fields) {
+        header.push_back(std::string(field.text, field.length));
+      }
+    }
+    return true;
+  }
+}
+
+int CsvReader::Column(const char *name) const {
+  for (size_t i = 0; i < header.size(); i++) {
+    if (header[i] == name) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+static bool IsBlank(const CsvField &field) {
+  for (int i = 0; i < field.length; i++) {
+    if (field.text[i] != ' ') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Digits with optional surrounding spaces
+static bool ParseInt(const CsvField &field, int *value) {
+  const char *p = field.text;
+  const char *end = p + field.length;
+  while (p < end && *p == ' ') {
+    p++;
+  }
+  while (end > p && end[-1] == ' ') {
+    end--;
+  }
+  long long result = 0;
+  for (const char *s = p; s < end; s++) {
+    if (*s < '0' || *s > '9' || result > 100000000) {
+      return false;
+    }
+    result = result * 10 + (*s - '0');
+  }
+  *value = (int)result;
+  return p < end;
+}
+
+static bool ParseFloat(const CsvField &field, float *value) {
+  char text[32];
+  if (field.length >= (int)sizeof(text)) {
+    return false;
+  }
+  memcpy(text, field.text, field.length);
+  text[field.length] = 0;
+  char *end;
+  *value = strtof(text, &end);
+  while (*end == ' ') {
+    end++;
+  }
+  return end != text && *end == 0;
+}
+
+// H:MM:SS, with hours past 24 for trips that run on past midnight
+static bool ParseTime(const CsvField &field, int *seconds) {
+  const char *colon = (const char *)memchr(field.text, ':', field.length);
+  if (!colon || field.text + field.length - colon != 6 || colon[3] != ':') {
+    return false;
+  }
+  CsvField hours = {field.text, (int)(colon - field.text)};
+  CsvField minutes = {colon + 1, 2};
+  CsvField rest = {colon + 4, 2};
+  int h, m, s;
+  if (!ParseInt(hours, &h) || !ParseInt(minutes, &m) || !ParseInt(rest, &s) ||
+      h > 240 || m > 59 || s > 59) {
+    return false;
+  }
+  *seconds = (h * 60 + m) * 60 + s;
+  return true;
+}
+
+// YYYYMMDD
+static bool ParseDate(const CsvField &field, int *day) {
+  int date;
+  if (!ParseInt(field, &date) || date < 10000101) {
+    return false;
+  }
+  int year = date / 10000;
+  int month = date / 100 % 100;
+  int dayOfMonth = date % 100;
+  if (month < 1 || month > 12 || dayOfMonth < 1 || dayOfMonth > 31) {
+    return false;
+  }
+  *day = DayNumber(year, month, dayOfMonth);
+  return true;
+}
+
+static std::string Text(const CsvField &field) {
+  return std::string(field.text, field.length);
+}
+
+// One file of the feed being read, with its error reporting
+struct FeedFile {
+  CsvReader csv;
+  const char *name;
+  TimetableError *error;
+
+  // Opens the file and reads its header; a missing optional file is not
+  // an error, and is skipped by returning false with no error set
+  bool Open(const char *directory, const char *fileName, bool required,
+            TimetableError *feedError) {
+    name = fileName;
+    error = feedError;
+    std::string path = std::string(directory) + "/" + fileName;
+    if (!csv.Open(path.c_str())) {
+      if (required) {
+        Fail(0, "cannot open %s", path.c_str());
+      }
+      return false;
+    }
+    if (!csv.NextRow()) {
+      Fail(0, "no header row");
+      return false;
+    }
+    return true;
+  }
+
+  // Index of a column, failing if it is missing
+  bool Column(const char *column, int *index) {
+    *index = csv.Column(column);
+    if (*index < 0) {
+      Fail(1, "no %s column", column);
+    }
+    return *index >= 0;
+  }
+
+  bool Fail(long long line, const char *format, ...) {
+    error->file = name;
+    error->line = line;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(error->message, sizeof(error->message), format, args);
+    va_end(args);
+    return false;
+  }
+
+  // Checks the file ended by running out rather than failing to read
+  bool Finished() {
+    return !csv.Failed() || Fail(0, "cannot read the file");
+  }
+};
+
+// Builds the timetable a file at a time
+struct FeedLoader {
+  const char *directory;
+  const TrackNetwork *network;
+  TimetableError *error;
+  Timetable *timetable;
+
+  std::unordered_map<std::string, int> stops;
+  std::vector<int> stopSegment;
+  std::vector<float> stopOffset;
+  std::unordered_map<std::string, int> services;
+  std::unordered_map<std::string, int> trips;
+  bool tripsListed = false; // Only trips in trips.txt may run
+
+  // Per trip as read, before sorting by departure
+  std::vector<int> originSequence;
+  std::vector<int> originStop;
+  std::vector<int> departure;
+  std::vector<int> tripService;
+  std::vector<std::string> tripId;
+
+  std::string key;
+
+  int Service(const CsvField &field) {
+    key.assign(field.text, field.length);
+    auto found = services.find(key);
+    if (found != services.end()) {
+      return found->second;
+    }
+    int service = (int)timetable->serviceWeekdays.size();
+    services[key] = service;
+    timetable->serviceWeekdays.push_back(0);
+    timetable->serviceFirstDay.push_back(0);
+    timetable->serviceLastDay.push_back(-1);
+    return service;
+  }
+
+  int AddTrip(const CsvField &field, int service) {
+    int trip = (int)tripId.size();
+    tripId.push_back(Text(field));
+    trips[tripId.back()] = trip;
+    tripService.push_back(service);
+    originSequence.push_back(0);
+    originStop.push_back(-1);
+    departure.push_back(0);
+    return trip;
+  }
+
+  bool LoadStops();
+  bool LoadCalendar();
+  bool LoadCalendarDates();
+  bool LoadTrips();
+  bool LoadStopTimes();
+  void Build();
+};
+
+bool FeedLoader::LoadStops() {
+  FeedFile file;
+  int id, segment, offset;
+  if (!file.Open(directory, "stops.txt", true, error) ||
+      !file.Column("stop_id", &id) || !file.Column("track_segment", &segment) ||
+      !file.Column("track_offset", &offset)) {
+    return false;
+  }
+  while (file.csv.NextRow()) {
+    const CsvReader &csv = file.csv;
+    int stopSegmentIndex;
+    float stopOffsetAlong;
+    if (!ParseInt(csv.Field(segment), &stopSegmentIndex) ||
+        !ParseFloat(csv.Field(offset), &stopOffsetAlong)) {
+      // Stops with no place on the network are fine until a trip uses one
+      stopSegmentIndex = -1;
+      stopOffsetAlong = 0.0f;
+    } else if (stopSegmentIndex >= network->SegmentCount() ||
+               stopOffsetAlong < 0.0f ||
+               stopOffsetAlong > network->segmentLength[stopSegmentIndex]) {
+      return file.Fail(csv.Line(), "stop is not on a segment");
+    }
+    std::string stopId = Text(csv.Field(id));
+    if (!stops.insert(std::make_pair(stopId, (int)stopSegment.size()))
+             .second) {
+      return file.Fail(csv.Line(), "stop %.40s defined twice",
+                       stopId.c_str());
+    }
+    stopSegment.push_back(stopSegmentIndex);
+    stopOffset.push_back(stopOffsetAlong);
+  }
+  return file.Finished();
+}
+
+bool FeedLoader::LoadCalendar() {
+  static const char *const weekdays[7] = {"monday", "tuesday", "wednesday",
+                                          "thursday", "friday", "saturday",
+                                          "sunday"};
+  FeedFile file;
+  int id, start, end;
+  int column[7];
+  if (!file.Open(directory, "calendar.txt", false, error)) {
+    return error->message[0] == 0;
+  }
+  if (!file.Column("service_id", &id) || !file.Column("start_date", &start) ||
+      !file.Column("end_date", &end)) {
+    return false;
+  }
+  for (int day = 0; day < 7; day++) {
+    if (!file.Column(weekdays[day], &column[day])) {
+      return false;
+    }
+  }
+  while (file.csv.NextRow()) {
+    const CsvReader &csv = file.csv;
+    int service = Service(csv.Field(id));
+    unsigned char runs = 0;
+    for (int day = 0; day < 7; day++) {
+      int flag;
+      if (!ParseInt(csv.Field(column[day]), &flag) || flag > 1) {
+        return file.Fail(csv.Line(), "%s is not 0 or 1", weekdays[day]);
+      }
+      runs |= flag << day;
+    }
+    if (!ParseDate(csv.Field(start), &timetable->serviceFirstDay[service]) ||
+        !ParseDate(csv.Field(end), &timetable->serviceLastDay[service])) {
+      return file.Fail(csv.Line(), "malformed date");
+    }
+    timetable->serviceWeekdays[service] = runs;
+  }
+  return file.Finished();
+}
+
+bool FeedLoader::LoadCalendarDates() {
+  FeedFile file;
+  int id, date, type;
+  if (!file.Open(directory, "calendar_dates.txt", false, error)) {
+    return error->message[0] == 0;
+  }
+  if (!file.Column("service_id", &id) || !file.Column("date", &date) ||
+      !file.Column("exception_type", &type)) {
+    return false;
+  }
+  while (file.csv.NextRow()) {
+    const CsvReader &csv = file.csv;
+    int service = Service(csv.Field(id));
+    int day, exception;
+    if (!ParseDate(csv.Field(date), &day)) {
+      return file.Fail(csv.Line(), "malformed date");
+    }
+    if (!ParseInt(csv.Field(type), &exception) ||
+        (exception != 1 && exception != 2)) {
+      return file.Fail(csv.Line(), "exception_type is not 1 or 2");
+    }
+    long long key = (long long)service << 32 | (unsigned)day;
+    (exception == 1 ? timetable->addedDates : timetable->removedDates)
+        .push_back(key);
+  }
+  std::sort(timetable->addedDates.begin(), timetable->addedDates.end());
+  std::sort(timetable->removedDates.begin(), timetable->removedDates.end());
+  return file.Finished();
+}
+
+bool FeedLoader::LoadTrips() {
+  FeedFile file;
+  int id, service;
+  if (!file.Open(directory, "trips.txt", false, error)) {
+    return error->message[0] == 0;
+  }
+  if (!file.Column("trip_id", &id) || !file.Column("service_id", &service)) {
+    return false;
+  }
+  tripsListed = true;
+  while (file.csv.NextRow()) {
+    const CsvReader &csv = file.csv;
+    key.assign(csv.Field(id).text, csv.Field(id).length);
+    if (trips.count(key)) {
+      return file.Fail(csv.Line(), "trip %.40s defined twice", key.c_str());
+    }
+    AddTrip(csv.Field(id), Service(csv.Field(service)));
+  }
+  return file.Finished();
+}
+
+bool FeedLoader::LoadStopTimes() {
+  FeedFile file;
+  int id, time, stop;
+  if (!file.Open(directory, "stop_times.txt", true, error) ||
+      !file.Column("trip_id", &id) || !file.Column("departure_time", &time) ||
+      !file.Column("stop_id", &stop)) {
+    return false;
+  }
+  int sequence = file.csv.Column("stop_sequence");
+
+  // Without trips.txt every trip runs on one service, every day
+  int everyDay = -1;
+  if (!tripsListed) {
+    everyDay = Service(CsvField{"", 0});
+    timetable->serviceWeekdays[everyDay] = 0x7f;
+    timetable->serviceFirstDay[everyDay] = INT32_MIN;
+    timetable->serviceLastDay[everyDay] = INT32_MAX;
+  }
+
+  // Feeds list a trip's stops together, so most rows are for the trip of
+  // the row before
+  std::string lastTripId;
+  int trip = -1;
+  while (file.csv.NextRow()) {
+    const CsvReader &csv = file.csv;
+    CsvField tripField = csv.Field(id);
+    if (trip < 0 || (int)lastTripId.size() != tripField.length ||
+        memcmp(lastTripId.data(), tripField.text, tripField.length) != 0) {
+      lastTripId.assign(tripField.text, tripField.length);
+      auto found = trips.find(lastTripId);
+      if (found != trips.end()) {
+        trip = found->second;
+      } else if (tripsListed) {
+        return file.Fail(csv.Line(), "trip %.40s is not in trips.txt",
+                         lastTripId.c_str());
+      } else {
+        trip = AddTrip(tripField, everyDay);
+      }
+    }
+
+    // Only times at the origin matter, and GTFS may leave stops between
+    // timepoints without one
+    CsvField timeField = csv.Field(time);
+    if (IsBlank(timeField)) {
+      continue;
+    }
+    int order = 0;
+    if (sequence >= 0 && !ParseInt(csv.Field(sequence), &order)) {
+      return file.Fail(csv.Line(), "malformed stop_sequence");
+    }
+    if (originStop[trip] >= 0 &&
+        (sequence < 0 || order >= originSequence[trip])) {
+      continue;
+    }
+    int seconds;
+    if (!ParseTime(timeField, &seconds)) {
+      return file.Fail(csv.Line(), "malformed departure_time");
+    }
+    key.assign(csv.Field(stop).text, csv.Field(stop).length);
+    auto found = stops.find(key);
+    if (found == stops.end() || stopSegment[found->second] < 0) {
+      return file.Fail(csv.Line(), "stop %.40s has no place on the network",
+                       key.c_str());
+    }
+    originSequence[trip] = order;
+    originStop[trip] = found->second;
+    departure[trip] = seconds;
+  }
+  return file.Finished();
+}
+
+// Sorts the trips that have an origin by departure, counting the trips
+// that leave each second
+void FeedLoader::Build() {
+  int lastDeparture = -1;
+  for (size_t trip = 0; trip < tripId.size(); trip++) {
+    if (originStop[trip] >= 0) {
+      lastDeparture = std::max(lastDeparture, departure[trip]);
+    }
+  }
+  std::vector<int> &firstAt = timetable->firstAt;
+  firstAt.assign(lastDeparture + 2, 0);
+  for (size_t trip = 0; trip < tripId.size(); trip++) {
+    if (originStop[trip] >= 0) {
+      firstAt[departure[trip] + 1]++;
+    }
+  }
+  for (size_t second = 1; second < firstAt.size(); second++) {
+    firstAt[second] += firstAt[second - 1];
+  }
+
+  int tripCount = firstAt.back();
+  timetable->departure.resize(tripCount);
+  timetable->originSegment.resize(tripCount);
+  timetable->originOffset.resize(tripCount);
+  timetable->tripService.resize(tripCount);
+  timetable->tripId.resize(tripCount);
+  std::vector<int> next(firstAt.begin(), firstAt.end() - 1);
+  for (size_t trip = 0; trip < tripId.size(); trip++) {
+    if (originStop[trip] < 0) {
+      continue;
+    }
+    int sorted = next[departure[trip]]++;
+    timetable->departure[sorted] = departure[trip];
+    timetable->originSegment[sorted] = stopSegment[originStop[trip]];
+    timetable->originOffset[sorted] = stopOffset[originStop[trip]];
+    timetable->tripService[sorted] = tripService[trip];
+    timetable->tripId[sorted].swap(tripId[trip]);
+  }
+}
+
+bool LoadTimetable(const char *directory, const TrackNetwork &network,
+                   Timetable *timetable, TimetableError *error) {
+  *error = TimetableError();
+  Timetable loaded;
+  FeedLoader loader;
+  loader.directory = directory;
+  loader.network = &network;
+  loader.error = error;
+  loader.timetable = &loaded;
+  if (!loader.LoadStops() || !loader.LoadCalendar() ||
+      !loader.LoadCalendarDates() || !loader.LoadTrips() ||
+      !loader.LoadStopTimes()) {
+    return false;
+  }
+  loader.Build();
+  *timetable = std::move(loaded);
+  return true;
+}
@@ -0,0 +1,111 @@
+#include "TimetableService.h"
+#include <math.h>
+
+// A train this close to the end of track, and this slow, has arrived
+static const float arrivedDistance = 1.0f;
+static const float arrivedSpeed = 0.01f;
+
+void TimetableService::Start(int day, double seconds) {
+  startDay = day;
+  clock = seconds;
+  slotTrip.clear();
+  waiting.clear();
+  departed = 0;
+  held = 0;
+  finished = 0;
+}
+
+// Places the trip's train with its tail at the origin, unless the track it
+// would stand on is occupied
+bool TimetableService::Depart(const Timetable &timetable,
+                              const TrackNetwork &network,
+                              Simulation *simulation, int trip) {
+  int tailSegment = timetable.originSegment[trip];
+  float tailOffset = timetable.originOffset[trip];
+  int headSegment = tailSegment;
+  float headOffset = tailOffset + trainLength;
+  spanned.assign(1, headSegment);
+  while (headOffset > network.segmentLength[headSegment]) {
+    int next = network.NextSegment(headSegment);
+    if (next < 0) {
+      headOffset = network.segmentLength[headSegment];
+      break;
+    }
+    headOffset -= network.segmentLength[headSegment];
+    headSegment = next;
+    spanned.push_back(headSegment);
+  }
+  for (int segment : spanned) {
+    if (!simulation->occupancy.IsClear(segment)) {
+      return false;
+    }
+  }
+  int train = simulation->PlaceTrain(network, headSegment, headOffset,
+                                     tailSegment, tailOffset, 0.0f, 0.0f,
+                                     stockIndex, lineSpeed);
+  slotTrip.resize(simulation->pool.SlotCount());
+  slotTrip[simulation->Handle(train).slot] = trip;
+  departed++;
+  return true;
+}
+
+void TimetableService::RemoveFinished(const TrackNetwork &network,
+                                      Simulation *simulation) {
+  // Removing a train moves the last into its place, so go from the back
+  const TrainFleet &fleet = simulation->fleet;
+  for (int train = fleet.Count(); train-- > 0;) {
+    int segment = fleet.segment[train];
+    if (network.NextSegment(segment) < 0 &&
+        network.segmentLength[segment] - fleet.offset[train] <=
+            arrivedDistance &&
+        fleet.speed[train] <= arrivedSpeed) {
+      simulation->RemoveTrain(train);
+      finished++;
+    }
+  }
+}
+
+void TimetableService::Advance(const Timetable &timetable,
+                               const TrackNetwork &network,
+                               Simulation *simulation, float dt) {
+  RemoveFinished(network, simulation);
+
+  // Departures held back go first, in the order they fell due
+  size_t kept = 0;
+  for (const ScheduledTrip &scheduled : waiting) {
+    if (!Depart(timetable, network, simulation, scheduled.trip)) {
+      waiting[kept++] = scheduled;
+    }
+  }
+  waiting.resize(kept);
+
+  // Whole seconds from the old clock up to the new one
+  long long from = (long long)ceil(clock);
+  clock += dt;
+  long long to = (long long)ceil(clock);
+  if (to <= from || timetable.TripCount() == 0) {
+    return;
+  }
+
+  // A day's departures run from its midnight to the last departure after
+  // it, so the window can reach back into earlier days
+  long long lastDeparture = timetable.LastDeparture();
+  long long firstDay = (long long)floor((double)(from - lastDeparture) /
+                                        secondsPerDay);
+  long long lastDay = (long long)floor((double)(to - 1) / secondsPerDay);
+  for (long long day = firstDay; day <= lastDay; day++) {
+    long long midnight = day * secondsPerDay;
+    int first, last;
+    timetable.DeparturesBetween(from - midnight, to - midnight, &first, &last);
+    for (int trip = first; trip < last; trip++) {
+      if (!timetable.Runs(trip, startDay + (int)day)) {
+        continue;
+      }
+      if (!Depart(timetable, network, simulation, trip)) {
+        ScheduledTrip scheduled = {trip, (int)day};
+        waiting.push_back(scheduled);
+        held++;
+      }
+    }
+  }
+}
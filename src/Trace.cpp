@@ -0,0 +1,108 @@
+#include "Trace.h"
+
+#ifdef RAILWAY_TRACE
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+// Events kept per thread; at 24 bytes each a ring takes 768 KB
+static const uint64_t ringCapacity = 32768;
+
+// Fields are atomic so a save may read a slot while its thread overwrites
+// it; such slots are found afterwards from the write count and dropped
+struct TraceEvent {
+  std::atomic<const char *> name;
+  std::atomic<uint64_t> begin;
+  std::atomic<uint64_t> end;
+};
+
+struct TraceRing {
+  int thread;
+  std::atomic<uint64_t> written{0};
+  TraceEvent events[ringCapacity];
+};
+
+// Rings are never freed, so a thread that has exited still shows in a save
+static std::mutex ringsMutex;
+static std::vector<TraceRing *> rings;
+static thread_local TraceRing *threadRing = nullptr;
+
+uint64_t TraceNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void TraceRecord(const char *name, uint64_t begin, uint64_t end) {
+  TraceRing *ring = threadRing;
+  if (!ring) {
+    ring = new TraceRing();
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    ring->thread = (int)rings.size();
+    rings.push_back(ring);
+    threadRing = ring;
+  }
+  uint64_t index = ring->written.load(std::memory_order_relaxed);
+  TraceEvent &event = ring->events[index % ringCapacity];
+  // A save that reads any of these stores then also sees written as at
+  // least index, so it drops the slot rather than mixing two events
+  std::atomic_thread_fence(std::memory_order_release);
+  event.name.store(name, std::memory_order_relaxed);
+  event.begin.store(begin, std::memory_order_relaxed);
+  event.end.store(end, std::memory_order_relaxed);
+  ring->written.store(index + 1, std::memory_order_release);
+}
+
+bool SaveTrace(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    return false;
+  }
+  std::vector<TraceRing *> saving;
+  {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    saving = rings;
+  }
+
+  struct Copied {
+    const char *name;
+    uint64_t begin;
+    uint64_t end;
+  };
+  std::vector<Copied> copied;
+  bool first = true;
+  fprintf(file, "{\"traceEvents\":[");
+  for (TraceRing *ring : saving) {
+    uint64_t written = ring->written.load(std::memory_order_acquire);
+    uint64_t oldest = written > ringCapacity ? written - ringCapacity : 0;
+    copied.clear();
+    for (uint64_t index = oldest; index < written; index++) {
+      const TraceEvent &event = ring->events[index % ringCapacity];
+      Copied copy = {event.name.load(std::memory_order_relaxed),
+                     event.begin.load(std::memory_order_relaxed),
+                     event.end.load(std::memory_order_relaxed)};
+      copied.push_back(copy);
+    }
+
+    // The thread may have lapped the copy; the slot it writes next may be
+    // half written too
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = ring->written.load(std::memory_order_relaxed);
+    uint64_t intact = after >= ringCapacity ? after - ringCapacity + 1 : 0;
+    for (uint64_t index = oldest > intact ? oldest : intact; index < written;
+         index++) {
+      const Copied &event = copied[index - oldest];
+      fprintf(file,
+              "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+              "\"pid\":1,\"tid\":%d}",
+              first ? "" : ",", event.name, event.begin / 1000.0,
+              (event.end - event.begin) / 1000.0, ring->thread);
+      first = false;
+    }
+  }
+  fprintf(file, "\n]}\n");
+  return fclose(file) == 0;
+}
+#endif
@@ -0,0 +1,109 @@
+#include "TrackNetwork.h"
+#include <math.h>
+
+int TrackNetwork::AddSegment(ImVec2 start, ImVec2 end) {
+  float dx = end.x - start.x;
+  float dy = end.y - start.y;
+  float length = sqrtf(dx * dx + dy * dy);
+  segmentStart.push_back(start);
+  segmentEnd.push_back(end);
+  segmentDirection.push_back(length > 0 ? ImVec2(dx / length, dy / length)
+                                        : ImVec2(0, 0));
+  segmentLength.push_back(length);
+  segmentNext.push_back(-1);
+  segmentSwitch.push_back(-1);
+  return SegmentCount() - 1;
+}
+
+void TrackNetwork::Connect(int from, int to) { segmentNext.Set(from, to); }
+
+int TrackNetwork::AddSwitch(int approach, int normal, int reverse) {
+  int switchIndex = SwitchCount();
+  switchApproach.push_back(approach);
+  switchNormal.push_back(normal);
+  switchReverse.push_back(reverse);
+  switchReversed.push_back(0);
+  segmentSwitch.Set(approach, switchIndex);
+  segmentNext.Set(approach, normal);
+
+  const int legs[2] = {normal, reverse};
+  for (int leg = 0; leg < 2; leg++) {
+    // A leg running into a loop with no switch on it stops once it has
+    // covered every segment
+    int remaining = SegmentCount();
+    for (int segment = legs[leg]; segment >= 0 && remaining-- > 0;
+         segment = segmentNext[segment]) {
+      legSegments.push_back(segment);
+      if (segmentSwitch[segment] >= 0) {
+        break;
+      }
+    }
+    legBegin.push_back((int)legSegments.size());
+  }
+  return switchIndex;
+}
+
+int TrackNetwork::AddSignal(int segment, float offset) {
+  signalSegment.push_back(segment);
+  signalOffset.push_back(offset);
+  return SignalCount() - 1;
+}
+
+int TrackNetwork::NextSegment(int segment) const {
+  int switchIndex = segmentSwitch[segment];
+  if (switchIndex < 0) {
+    return segmentNext[segment];
+  }
+  return switchReversed[switchIndex] ? switchReverse[switchIndex]
+                                     : switchNormal[switchIndex];
+}
+
+int TrackNetwork::PreviousSegment(int segment) const {
+  for (int i = 0; i < SegmentCount(); i++) {
+    int switchIndex = segmentSwitch[i];
+    if (switchIndex < 0 ? segmentNext[i] == segment
+                        : switchNormal[switchIndex] == segment ||
+                              switchReverse[switchIndex] == segment) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+ImVec2 TrackNetwork::PointAt(int segment, float offset) const {
+  float t = segmentLength[segment] > 0 ? offset / segmentLength[segment] : 0;
+  ImVec2 start = segmentStart[segment];
+  ImVec2 end = segmentEnd[segment];
+  return ImVec2(start.x + (end.x - start.x) * t,
+                start.y + (end.y - start.y) * t);
+}
+
+float TrackNetwork::OffsetOf(int segment, ImVec2 point) const {
+  float length = segmentLength[segment];
+  if (length <= 0) {
+    return 0;
+  }
+  ImVec2 start = segmentStart[segment];
+  ImVec2 end = segmentEnd[segment];
+  float offset = ((point.x - start.x) * (end.x - start.x) +
+                  (point.y - start.y) * (end.y - start.y)) /
+                 length;
+  return offset < 0 ? 0 : (offset > length ? length : offset);
+}
+
+void TrackNetwork::AddMemoryUsage(MemoryUsage *usage) const {
+  usage->Add(segmentStart.HeapBytes());
+  usage->Add(segmentEnd.HeapBytes());
+  usage->Add(segmentDirection.HeapBytes());
+  usage->Add(segmentLength.HeapBytes());
+  usage->Add(segmentNext.HeapBytes());
+  usage->Add(segmentSwitch.HeapBytes());
+  usage->Add(switchApproach.HeapBytes());
+  usage->Add(switchNormal.HeapBytes());
+  usage->Add(switchReverse.HeapBytes());
+  usage->Add(switchReversed.HeapBytes());
+  usage->Add(legSegments.HeapBytes());
+  usage->Add(legBegin.HeapBytes());
+  usage->Add(signalSegment.HeapBytes());
+  usage->Add(signalOffset.HeapBytes());
+}
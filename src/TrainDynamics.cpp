@@ -0,0 +1,183 @@
+#include "TrainDynamics.h"
+#include <stddef.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) &&                              \
+    (defined(__x86_64__) || defined(__i386__))
+#define DYNAMICS_HAS_AVX2 1
+#include <immintrin.h>
+#endif
+
+static float SampleCurve(const std::vector<CurvePoint> &curve, float speed) {
+  if (curve.empty()) {
+    return 0.0f;
+  }
+  if (speed <= curve.front().speed) {
+    return curve.front().force;
+  }
+  for (size_t i = 1; i < curve.size(); i++) {
+    if (speed <= curve[i].speed) {
+      const CurvePoint &a = curve[i - 1];
+      const CurvePoint &b = curve[i];
+      return a.force + (b.force - a.force) * (speed - a.speed) /
+                           (b.speed - a.speed);
+    }
+  }
+  return curve.back().force;
+}
+
+StockTables BuildStockTables(const RollingStock &stock) {
+  StockTables tables;
+  tables.speedStep = stock.maxSpeed / (StockTables::sampleCount - 1);
+  tables.inverseSpeedStep = 1.0f / tables.speedStep;
+  tables.minBraking = 0.0f;
+  for (int i = 0; i < StockTables::sampleCount; i++) {
+    float speed = i * tables.speedStep;
+    float resistance = stock.resistanceA + stock.resistanceB * speed +
+                       stock.resistanceC * speed * speed;
+    float traction = SampleCurve(stock.tractiveEffort, speed) - resistance;
+    float braking = SampleCurve(stock.brakingForce, speed) + resistance;
+    tables.traction[i] = traction / stock.mass;
+    tables.braking[i] = braking / stock.mass;
+    if (i == 0 || tables.braking[i] < tables.minBraking) {
+      tables.minBraking = tables.braking[i];
+    }
+  }
+  // No traction past the top speed
+  tables.traction[StockTables::sampleCount - 1] = 0.0f;
+  return tables;
+}
+
+void StepDynamics(TrainFleet *fleet, const PackedTrain *trains,
+                  const std::vector<StockTables> &tables, float dt) {
+  StepDynamics(fleet, trains, tables, dt, 0, fleet->Count());
+}
+
+void StepDynamicsScalar(TrainFleet *fleet, const PackedTrain *trains,
+                        const std::vector<StockTables> &tables, float dt,
+                        int begin, int end) {
+  const int lastSample = StockTables::sampleCount - 1;
+  const float inverseDt = 1.0f / dt;
+  const float *targetSpeed = fleet->targetSpeed.data();
+  float *speed = fleet->speed.data();
+  float *acceleration = fleet->acceleration.data();
+
+  for (int i = begin; i < end; i++) {
+    const StockTables &table = tables[trains[i].stock];
+    float v = speed[i];
+    float position = v * table.inverseSpeedStep;
+    position = position < (float)lastSample ? position : (float)lastSample;
+    int sample = (int)position;
+    sample = sample < lastSample ? sample : lastSample - 1;
+    float t = position - (float)sample;
+    float traction = table.traction[sample] +
+                     (table.traction[sample + 1] - table.traction[sample]) * t;
+    float braking = table.braking[sample] +
+                    (table.braking[sample + 1] - table.braking[sample]) * t;
+
+    // Close the gap to the target speed as fast as the curves allow
+    float wanted = (targetSpeed[i] - v) * inverseDt;
+    float a = wanted < traction ? wanted : traction;
+    a = a > -braking ? a : -braking;
+
+    float newSpeed = v + a * dt;
+    newSpeed = newSpeed > 0.0f ? newSpeed : 0.0f;
+    acceleration[i] = (newSpeed - v) * inverseDt;
+    speed[i] = newSpeed;
+  }
+}
+
+#ifdef DYNAMICS_HAS_AVX2
+// The scalar loop eight trains at a time, with the table lookups gathered.
+// Multiplies and adds stay separate, as fusing them would round
+// differently from the scalar loop.
+__attribute__((target("avx2"))) static void
+StepDynamicsAvx2(TrainFleet *fleet, const PackedTrain *trains,
+                 const std::vector<StockTables> &tables, float dt, int begin,
+                 int end) {
+  const int lastSample = StockTables::sampleCount - 1;
+  const float *targetSpeed = fleet->targetSpeed.data();
+  float *speed = fleet->speed.data();
+  float *acceleration = fleet->acceleration.data();
+
+  // Tables are gathered as floats, a stock's lying tableFloats apart
+  static_assert(sizeof(StockTables) % sizeof(float) == 0,
+                "StockTables must be whole floats");
+  static_assert(sizeof(PackedTrain) == 8 &&
+                    offsetof(PackedTrain, stock) == 6,
+                "stock is gathered from the top half of a record's second "
+                "word");
+  const float *base = (const float *)tables.data();
+  const __m256i tableFloats =
+      _mm256_set1_epi32((int)(sizeof(StockTables) / sizeof(float)));
+  const int inverseSpeedStepAt =
+      (int)(offsetof(StockTables, inverseSpeedStep) / sizeof(float));
+  const __m256i tractionAt = _mm256_set1_epi32(
+      (int)(offsetof(StockTables, traction) / sizeof(float)));
+  const __m256i brakingAt = _mm256_set1_epi32(
+      (int)(offsetof(StockTables, braking) / sizeof(float)));
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i lastStart = _mm256_set1_epi32(lastSample - 1);
+  const __m256i recordWords = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+  const __m256 last = _mm256_set1_ps((float)lastSample);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 signBit = _mm256_set1_ps(-0.0f);
+  const __m256 dtVector = _mm256_set1_ps(dt);
+  const __m256 inverseDt = _mm256_set1_ps(1.0f / dt);
+
+  int i = begin;
+  for (; i + 8 <= end; i += 8) {
+    const int *words = (const int *)(trains + i) + 1;
+    __m256i stock = _mm256_srli_epi32(
+        _mm256_i32gather_epi32(words, recordWords, 4), 16);
+    __m256i table = _mm256_mullo_epi32(stock, tableFloats);
+
+    __m256 v = _mm256_loadu_ps(speed + i);
+    __m256 inverseSpeedStep =
+        _mm256_i32gather_ps(base + inverseSpeedStepAt, table, 4);
+    __m256 position = _mm256_min_ps(_mm256_mul_ps(v, inverseSpeedStep), last);
+    __m256i sample =
+        _mm256_min_epi32(_mm256_cvttps_epi32(position), lastStart);
+    __m256 t = _mm256_sub_ps(position, _mm256_cvtepi32_ps(sample));
+
+    __m256i at = _mm256_add_epi32(_mm256_add_epi32(table, tractionAt), sample);
+    __m256 low = _mm256_i32gather_ps(base, at, 4);
+    __m256 high = _mm256_i32gather_ps(base, _mm256_add_epi32(at, one), 4);
+    __m256 traction =
+        _mm256_add_ps(low, _mm256_mul_ps(_mm256_sub_ps(high, low), t));
+    at = _mm256_add_epi32(_mm256_add_epi32(table, brakingAt), sample);
+    low = _mm256_i32gather_ps(base, at, 4);
+    high = _mm256_i32gather_ps(base, _mm256_add_epi32(at, one), 4);
+    __m256 braking =
+        _mm256_add_ps(low, _mm256_mul_ps(_mm256_sub_ps(high, low), t));
+
+    __m256 wanted = _mm256_mul_ps(
+        _mm256_sub_ps(_mm256_loadu_ps(targetSpeed + i), v), inverseDt);
+    __m256 a = _mm256_min_ps(wanted, traction);
+    a = _mm256_max_ps(a, _mm256_xor_ps(braking, signBit));
+
+    __m256 newSpeed =
+        _mm256_max_ps(_mm256_add_ps(v, _mm256_mul_ps(a, dtVector)), zero);
+    _mm256_storeu_ps(acceleration + i,
+                     _mm256_mul_ps(_mm256_sub_ps(newSpeed, v), inverseDt));
+    _mm256_storeu_ps(speed + i, newSpeed);
+  }
+  StepDynamicsScalar(fleet, trains, tables, dt, i, end);
+}
+
+static bool HasAvx2() {
+  static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+  return hasAvx2;
+}
+#endif
+
+void StepDynamics(TrainFleet *fleet, const PackedTrain *trains,
+                  const std::vector<StockTables> &tables, float dt, int begin,
+                  int end) {
+#ifdef DYNAMICS_HAS_AVX2
+  if (HasAvx2()) {
+    StepDynamicsAvx2(fleet, trains, tables, dt, begin, end);
+    return;
+  }
+#endif
+  StepDynamicsScalar(fleet, trains, tables, dt, begin, end);
+}
@@ -0,0 +1,49 @@
+#include "TrainFleet.h"
+
+int TrainFleet::Add(int headSegment, float headOffset) {
+  segment.push_back(headSegment);
+  offset.push_back(headOffset);
+  x.push_back(0.0f);
+  y.push_back(0.0f);
+  speed.push_back(0.0f);
+  acceleration.push_back(0.0f);
+  targetSpeed.push_back(0.0f);
+  tailOffset.push_back(headOffset);
+  return Count() - 1;
+}
+
+void TrainFleet::AddMemoryUsage(MemoryUsage *usage) const {
+  usage->Add(segment);
+  usage->Add(offset);
+  usage->Add(x);
+  usage->Add(y);
+  usage->Add(speed);
+  usage->Add(acceleration);
+  usage->Add(targetSpeed);
+  usage->Add(tailOffset);
+}
+
+void CrossSegments(TrainFleet *fleet, const TrackNetwork &network,
+                   const int *crossed, int count,
+                   std::vector<int> *reachedEnd) {
+  reachedEnd->clear();
+  for (int j = 0; j < count; j++) {
+    int i = crossed[j];
+    while (fleet->offset[i] >= network.segmentLength[fleet->segment[i]]) {
+      float length = network.segmentLength[fleet->segment[i]];
+      int next = network.NextSegment(fleet->segment[i]);
+      if (next < 0) {
+        fleet->offset[i] = length;
+        fleet->speed[i] = 0.0f;
+        fleet->acceleration[i] = 0.0f;
+        reachedEnd->push_back(i);
+        break;
+      }
+      fleet->offset[i] -= length;
+      fleet->segment[i] = next;
+    }
+    ImVec2 head = network.PointAt(fleet->segment[i], fleet->offset[i]);
+    fleet->x[i] = head.x;
+    fleet->y[i] = head.y;
+  }
+}
@@ -0,0 +1,87 @@
+#include "TrainPool.h"
+
+TrainHandle TrainPool::Add(int train) {
+  int slot = freeSlot;
+  if (slot >= 0) {
+    freeSlot = -2 - slotTrain[slot];
+    freeCount--;
+  } else {
+    slot = (int)slotTrain.size();
+    slotTrain.push_back(-1);
+    slotGeneration.push_back(retiredGeneration);
+  }
+  slotTrain[slot] = train;
+  if ((int)trainSlot.size() <= train) {
+    trainSlot.resize(train + 1);
+  }
+  trainSlot[train] = slot;
+  return Handle(train);
+}
+
+void TrainPool::Remove(int train) {
+  int slot = trainSlot[train];
+  int last = (int)trainSlot.size() - 1;
+  if (train != last) {
+    trainSlot[train] = trainSlot[last];
+    slotTrain[trainSlot[train]] = train;
+  }
+  trainSlot.pop_back();
+
+  slotTrain[slot] = -2 - freeSlot;
+  slotGeneration[slot]++;
+  freeSlot = slot;
+  freeCount++;
+}
+
+void TrainPool::Clear() {
+  trainSlot.clear();
+  freeSlot = -1;
+  freeCount = 0;
+  for (int slot = SlotCount(); slot-- > 0;) {
+    // Keep the generations, so no handle given out so far resolves again
+    if (slotTrain[slot] >= 0) {
+      slotGeneration[slot]++;
+    }
+    slotTrain[slot] = -2 - freeSlot;
+    freeSlot = slot;
+    freeCount++;
+  }
+}
+
+void TrainPool::Compact() {
+  while (!slotTrain.empty() && slotTrain.back() < 0) {
+    if (retiredGeneration <= slotGeneration.back()) {
+      retiredGeneration = slotGeneration.back() + 1;
+    }
+    slotTrain.pop_back();
+    slotGeneration.pop_back();
+  }
+
+  // Relink the remaining free slots so the lowest are reused first, leaving
+  // the end of the table free for the next compaction
+  freeSlot = -1;
+  freeCount = 0;
+  for (int slot = SlotCount(); slot-- > 0;) {
+    if (slotTrain[slot] < 0) {
+      slotTrain[slot] = -2 - freeSlot;
+      freeSlot = slot;
+      freeCount++;
+    }
+  }
+}
+
+int TrainPool::Find(TrainHandle handle) const {
+  if (handle.slot < 0 || handle.slot >= SlotCount() ||
+      slotGeneration[handle.slot] != handle.generation) {
+    return -1;
+  }
+  int train = slotTrain[handle.slot];
+  return train >= 0 ? train : -1;
+}
+
+TrainHandle TrainPool::Handle(int train) const {
+  TrainHandle handle;
+  handle.slot = trainSlot[train];
+  handle.generation = slotGeneration[handle.slot];
+  return handle;
+}
@@ -0,0 +1,55 @@
+#include "WhatIfBranch.h"
+
+void WhatIfBranch::Fork(const TrackNetwork &liveNetwork,
+                        const Simulation &live) {
+  Discard();
+  network = liveNetwork;
+  live.Capture(&snapshot);
+  forked = true;
+}
+
+void WhatIfBranch::Run(int ticks, float dt) {
+  if (!forked || thread.joinable()) {
+    return;
+  }
+  stopping = false;
+  done = false;
+  ticksRun = 0;
+  reachedEndTick = -1;
+  thread = std::thread([this, ticks, dt]() { Step(ticks, dt); });
+}
+
+void WhatIfBranch::Step(int ticks, float dt) {
+  // Building occupancy is the part sized by the network, so it happens here
+  // rather than in Fork()
+  simulation.Restore(network, snapshot);
+  const TrainFleet &fleet = simulation.fleet;
+  for (int tick = 0; tick < ticks && !stopping.load(); tick++) {
+    simulation.Step(network, nullptr, nullptr, nullptr, dt, nullptr);
+    ticksRun = tick + 1;
+    if (reachedEndTick < 0 && !simulation.reachedEnd.empty()) {
+      reachedEndTick = tick + 1;
+    }
+
+    bool standing = true;
+    for (int i = 0; i < fleet.Count() && standing; i++) {
+      standing = fleet.speed[i] == 0.0f;
+    }
+    if (standing) {
+      break;
+    }
+  }
+  done = true;
+}
+
+void WhatIfBranch::Discard() {
+  stopping = true;
+  if (thread.joinable()) {
+    thread.join();
+  }
+  network.Clear();
+  simulation = Simulation();
+  forked = false;
+  done = false;
+  ticksRun = 0;
+}
@@ -0,0 +1,395 @@
+// Timings of the simulation's hot paths, for checking an optimisation and
+// catching regressions. Inputs are generated at fixed sizes from fixed
+// seeds, so runs on one machine can be compared; build with make
+// OPTIMIZE=1, as unoptimised timings mean little.
+//
+//   bench kinematics [trains] [ticks]
+//   bench threads [trains] [ticks] [most threads]
+//   bench regions [trains] [ticks] [regions]
+//   bench text [megabytes] [threads]
+//   bench fleet [trains] [ticks]
+#include "Kinematics.h"
+#include "LayoutText.h"
+#include "RegionSimulation.h"
+#include "Simulation.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Same sequence on every run and platform
+static unsigned NextRandom(unsigned *state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+static float RandomBetween(unsigned *state, float low, float high) {
+  return low + (high - low) * (NextRandom(state) & 0xffff) / 65535.0f;
+}
+
+// Segments laid out in every direction, long enough that no train reaches
+// the end of one while timing
+static void BuildScatteredNetwork(TrackNetwork *network, int segmentCount,
+                                  unsigned *seed) {
+  for (int i = 0; i < segmentCount; i++) {
+    ImVec2 start(RandomBetween(seed, -1e4f, 1e4f),
+                 RandomBetween(seed, -1e4f, 1e4f));
+    float angle = RandomBetween(seed, 0.0f, 6.2831853f);
+    network->AddSegment(start, ImVec2(start.x + 1e6f * cosf(angle),
+                                      start.y + 1e6f * sinf(angle)));
+  }
+}
+
+static void BuildFleet(TrainFleet *fleet, int trainCount, int segmentCount,
+                       unsigned *seed) {
+  for (int i = 0; i < trainCount; i++) {
+    int train = fleet->Add((int)(NextRandom(seed) % segmentCount),
+                           RandomBetween(seed, 0.0f, 1000.0f));
+    fleet->speed[train] = RandomBetween(seed, 0.0f, 25.0f);
+    fleet->acceleration[train] = RandomBetween(seed, -1.0f, 1.0f);
+  }
+}
+
+// The vector path against the scalar loop it replaces, over the same fleet
+static int BenchKinematics(int trainCount, int ticks) {
+  const int segmentCount = 4096;
+  const float dt = 1.0f / 60.0f;
+  unsigned seed = 1;
+  TrackNetwork network;
+  BuildScatteredNetwork(&network, segmentCount, &seed);
+  TrainFleet scalarFleet;
+  BuildFleet(&scalarFleet, trainCount, segmentCount, &seed);
+  TrainFleet dispatchedFleet = scalarFleet;
+  std::vector<int> crossed;
+
+  Clock::time_point start = Clock::now();
+  for (int tick = 0; tick < ticks; tick++) {
+    UpdateKinematicsScalar(&scalarFleet, network, dt, &crossed);
+  }
+  double scalar = SecondsSince(start);
+  start = Clock::now();
+  for (int tick = 0; tick < ticks; tick++) {
+    UpdateKinematics(&dispatchedFleet, network, dt, &crossed);
+  }
+  double dispatched = SecondsSince(start);
+
+  // Fused multiply-adds round once where the scalar loop rounds twice
+  float largest = 0.0f;
+  for (int i = 0; i < trainCount; i++) {
+    largest = fmaxf(largest,
+                    fabsf(scalarFleet.x[i] - dispatchedFleet.x[i]));
+    largest = fmaxf(largest,
+                    fabsf(scalarFleet.y[i] - dispatchedFleet.y[i]));
+  }
+
+  double perTick = 1e9 / ((double)trainCount * ticks);
+  printf("kinematics: %d trains, %d ticks\n", trainCount, ticks);
+  printf("  Scalar %8.3f ns/train\n", scalar * perTick);
+  printf("  %-6s %8.3f ns/train, %.2fx\n", KinematicsImplementation(),
+         dispatched * perTick, scalar / dispatched);
+  printf("  largest position difference %g\n", largest);
+  return 0;
+}
+
+static std::vector<StockTables> BuildStock() {
+  RollingStock stock;
+  stock.mass = 40000;
+  stock.maxSpeed = 25;
+  stock.tractiveEffort = {{0, 40000}, {25, 8000}};
+  stock.brakingForce = {{0, 48000}};
+  stock.resistanceA = 600;
+  stock.resistanceB = 10;
+  stock.resistanceC = 1.5f;
+  return std::vector<StockTables>(1, BuildStockTables(stock));
+}
+
+// A line with a train ten units long on every other segment, so trains
+// run up behind one another and cross segments as the ticks go by
+static void BuildLine(TrackNetwork *network, int trainCount) {
+  const float segmentLength = 20.0f;
+  int segmentCount = 2 * trainCount + 10;
+  for (int i = 0; i < segmentCount; i++) {
+    network->AddSegment(ImVec2(i * segmentLength, 0),
+                        ImVec2((i + 1) * segmentLength, 0));
+    if (i > 0) {
+      network->Connect(i - 1, i);
+    }
+  }
+}
+
+static int LineTrainSegment(int train) { return 2 * train + 1; }
+static float LineTrainSpeed(int train) { return 10.0f + train % 5; }
+
+static void BuildLineSimulation(TrackNetwork *network, Simulation *simulation,
+                                int trainCount) {
+  BuildLine(network, trainCount);
+  simulation->stock = BuildStock();
+  simulation->Reset(*network);
+  for (int i = 0; i < trainCount; i++) {
+    int segment = LineTrainSegment(i);
+    simulation->PlaceTrain(*network, segment, 15.0f, segment, 5.0f, 0.0f,
+                           0.0f, 0, LineTrainSpeed(i));
+  }
+}
+
+// Simulation::Step over one fleet with the job system at each size from
+// the calling thread alone up to mostThreads
+static int BenchThreads(int trainCount, int ticks, int mostThreads) {
+  const float dt = 1.0f / 60.0f;
+  const int warmUpTicks = 10;
+  printf("threads: %d trains, %d ticks\n", trainCount, ticks);
+  std::vector<float> singleX;
+  double single = 0.0;
+  for (int threads = 1; threads <= mostThreads; threads++) {
+    TrackNetwork network;
+    Simulation simulation;
+    BuildLineSimulation(&network, &simulation, trainCount);
+    JobSystem jobs(threads - 1);
+    for (int tick = 0; tick < warmUpTicks; tick++) {
+      simulation.Step(network, nullptr, nullptr, nullptr, dt, &jobs);
+    }
+    Clock::time_point start = Clock::now();
+    for (int tick = 0; tick < ticks; tick++) {
+      simulation.Step(network, nullptr, nullptr, nullptr, dt, &jobs);
+    }
+    double seconds = SecondsSince(start);
+
+    // Every thread count must step the trains the same
+    const std::vector<float> &x = simulation.fleet.x;
+    float largest = 0.0f;
+    if (threads == 1) {
+      singleX = x;
+      single = seconds;
+    } else {
+      for (int i = 0; i < trainCount; i++) {
+        largest = fmaxf(largest, fabsf(x[i] - singleX[i]));
+      }
+    }
+    printf("  %2d threads %8.3f ms/tick, %.2fx, largest difference %g\n",
+           threads, seconds * 1000.0 / ticks, single / seconds, largest);
+  }
+  return 0;
+}
+
+// RegionSimulation's workers against one simulation of the same trains,
+// which must end up in the same places
+static int BenchRegions(int trainCount, int ticks, int regionCount) {
+  const float dt = 1.0f / 60.0f;
+  printf("regions: %d trains, %d ticks, %d regions\n", trainCount, ticks,
+         regionCount);
+  TrackNetwork network;
+  Simulation single;
+  BuildLineSimulation(&network, &single, trainCount);
+  Clock::time_point start = Clock::now();
+  for (int tick = 0; tick < ticks; tick++) {
+    single.Step(network, nullptr, nullptr, nullptr, dt, nullptr);
+  }
+  double singleSeconds = SecondsSince(start);
+
+  RegionSimulation regions;
+  regions.Build(network, PartitionSegments(network, regionCount),
+                BuildStock());
+  for (int i = 0; i < trainCount; i++) {
+    regions.AddTrain(network, LineTrainSegment(i), 15.0f, 10.0f, 0,
+                     LineTrainSpeed(i));
+  }
+  start = Clock::now();
+  for (int tick = 0; tick < ticks; tick++) {
+    regions.Step(network, dt);
+  }
+  double regionSeconds = SecondsSince(start);
+
+  float largest = 0.0f;
+  for (int id = 0; id < trainCount; id++) {
+    const TrainFleet &fleet = regions.Region(regions.trainRegion[id]).fleet;
+    int index = regions.TrainIndex(id);
+    largest = fmaxf(largest, fabsf(fleet.x[index] - single.fleet.x[id]));
+  }
+  printf("  one simulation %8.3f ms/tick\n", singleSeconds * 1000.0 / ticks);
+  printf("  regions        %8.3f ms/tick, %.2fx, largest difference %g\n",
+         regionSeconds * 1000.0 / ticks, singleSeconds / regionSeconds,
+         largest);
+  return largest == 0.0f ? 0 : 1;
+}
+
+// Memory held per train and the cost of a tick, a snapshot and a restore
+// for a large fleet. The snapshot must step on exactly as the simulation
+// it was taken from.
+static int BenchFleet(int trainCount, int ticks) {
+  const float dt = 1.0f / 60.0f;
+  TrackNetwork network;
+  Simulation simulation;
+  BuildLineSimulation(&network, &simulation, trainCount);
+  int hardware = (int)std::thread::hardware_concurrency();
+  JobSystem jobs(std::max(hardware, 1) - 1);
+  simulation.Step(network, nullptr, nullptr, nullptr, dt, &jobs);
+
+  MemoryUsage lanes;
+  simulation.fleet.AddMemoryUsage(&lanes);
+  MemoryUsage usage;
+  simulation.AddMemoryUsage(&usage);
+  printf("fleet: %d trains, %d ticks, %d threads\n", trainCount, ticks,
+         jobs.ThreadCount());
+  printf("  records %.1f B/train in lanes + %d B packed, simulation holds "
+         "%.1f B/train\n",
+         (double)lanes.bytes / simulation.fleet.segment.capacity(),
+         (int)sizeof(PackedTrain), (double)usage.bytes / trainCount);
+
+  Clock::time_point start = Clock::now();
+  for (int tick = 0; tick < ticks; tick++) {
+    simulation.Step(network, nullptr, nullptr, nullptr, dt, &jobs);
+  }
+  double stepping = SecondsSince(start);
+
+  SimulationSnapshot snapshot;
+  start = Clock::now();
+  simulation.Capture(&snapshot);
+  double capture = SecondsSince(start);
+  Simulation restored;
+  start = Clock::now();
+  restored.Restore(network, snapshot);
+  double restore = SecondsSince(start);
+
+  for (int tick = 0; tick < ticks; tick++) {
+    simulation.Step(network, nullptr, nullptr, nullptr, dt, &jobs);
+    restored.Step(network, nullptr, nullptr, nullptr, dt, &jobs);
+  }
+  float largest = 0.0f;
+  for (int i = 0; i < trainCount; i++) {
+    largest = fmaxf(largest, fabsf(restored.fleet.x[i] -
+                                   simulation.fleet.x[i]));
+  }
+  printf("  step %.3f ms/tick, capture %.3f ms, restore %.3f ms\n",
+         stepping * 1e3 / ticks, capture * 1e3, restore * 1e3);
+  printf("  largest difference after restoring %g\n", largest);
+  return largest == 0.0f ? 0 : 1;
+}
+
+// A main line with a one-segment siding off a switch and a signal every
+// 64 segments; about 45 bytes a segment once written as text
+static void BuildTextLayout(TrackNetwork *network, int segmentCount) {
+  const float segmentLength = 20.0f;
+  const int switchSpacing = 64;
+  int mainCount = segmentCount * switchSpacing / (switchSpacing + 1);
+  for (int i = 0; i < mainCount; i++) {
+    network->AddSegment(ImVec2(i * segmentLength, 0),
+                        ImVec2((i + 1) * segmentLength, 0));
+    if (i > 0 && i % switchSpacing != 0) {
+      network->Connect(i - 1, i);
+    }
+  }
+  for (int i = switchSpacing; i < mainCount; i += switchSpacing) {
+    ImVec2 start(i * segmentLength, 0);
+    int siding = network->AddSegment(
+        start, ImVec2(start.x + segmentLength, -5.0f));
+    network->Connect(i - 1, i);
+    network->Connect(i - 1, siding);
+    network->AddSwitch(i - 1, i, siding);
+    network->AddSignal(siding, 1.0f);
+  }
+}
+
+// ImportLayoutText over a generated file, best of a few runs, as the first
+// run also pays for reading the file into the page cache
+static int BenchText(double megabytes, int threads) {
+  const int runs = 3;
+  TrackNetwork network;
+  BuildTextLayout(&network, (int)(megabytes * 1e6 / 45.0));
+  char path[] = "/tmp/bench_layout.XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return 1;
+  }
+  close(fd);
+  if (!ExportLayoutText(path, network)) {
+    fprintf(stderr, "bench: cannot write %s\n", path);
+    unlink(path);
+    return 1;
+  }
+  struct stat status;
+  double size = stat(path, &status) == 0 ? status.st_size / 1e6 : 0.0;
+
+  JobSystem jobs(threads - 1);
+  printf("text: %.1f MB, %d segments, %d threads\n", size,
+         network.SegmentCount(), jobs.ThreadCount());
+  double best = INFINITY;
+  bool failed = false;
+  for (int run = 0; run < runs && !failed; run++) {
+    TrackNetwork imported;
+    LayoutTextError error;
+    Clock::time_point start = Clock::now();
+    failed = !ImportLayoutText(path, &imported, &jobs, &error) ||
+             imported.SegmentCount() != network.SegmentCount() ||
+             imported.SwitchCount() != network.SwitchCount();
+    best = std::min(best, SecondsSince(start));
+    if (failed) {
+      fprintf(stderr, "bench: %s:%lld: %s\n", path, error.line,
+              error.message);
+    }
+  }
+  unlink(path);
+  if (failed) {
+    return 1;
+  }
+  printf("  imported in %.3f s, %.1f MB/s\n", best, size / best);
+  return 0;
+}
+
+static void Usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s kinematics [trains] [ticks]\n"
+          "       %s threads [trains] [ticks] [most threads]\n"
+          "       %s regions [trains] [ticks] [regions]\n"
+          "       %s text [megabytes] [threads]\n"
+          "       %s fleet [trains] [ticks]\n",
+          name, name, name, name, name);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    Usage(argv[0]);
+    return 1;
+  }
+  int first = argc > 2 ? atoi(argv[2]) : 0;
+  int second = argc > 3 ? atoi(argv[3]) : 0;
+  int third = argc > 4 ? atoi(argv[4]) : 0;
+  if (strcmp(argv[1], "kinematics") == 0) {
+    return BenchKinematics(first > 0 ? first : 1000000,
+                           second > 0 ? second : 200);
+  }
+  if (strcmp(argv[1], "threads") == 0) {
+    int hardware = (int)std::thread::hardware_concurrency();
+    return BenchThreads(first > 0 ? first : 200000,
+                        second > 0 ? second : 200,
+                        third > 0 ? third : std::max(hardware, 1));
+  }
+  if (strcmp(argv[1], "regions") == 0) {
+    int hardware = (int)std::thread::hardware_concurrency();
+    return BenchRegions(first > 0 ? first : 200000,
+                        second > 0 ? second : 200,
+                        third > 0 ? third : std::max(hardware, 2));
+  }
+  if (strcmp(argv[1], "text") == 0) {
+    int hardware = (int)std::thread::hardware_concurrency();
+    return BenchText(first > 0 ? first : 64.0,
+                     second > 0 ? second : std::max(hardware, 1));
+  }
+  if (strcmp(argv[1], "fleet") == 0) {
+    return BenchFleet(first > 0 ? first : 1000000,
+                      second > 0 ? second : 100);
+  }
+  Usage(argv[0]);
+  return 1;
+}
@@ -0,0 +1,168 @@
+// Writes layout files, and times reading them back.
+//
+//   layout_convert demo <track length> <switch position> <out>
+//   layout_convert yard <sidings> <segments per siding> <out>
+//   layout_convert text <in> <out>
+//   layout_convert railml <in> <out>
+//
+// demo is the layout main.cpp builds from its track settings; yard is a
+// ladder of sidings off a main line, for trying out large networks; text
+// imports a text layout and railml a railML infrastructure file. Output
+// ending in .txt is written as text, anything else as a binary layout for
+// LoadLayout.
+#include "LayoutFile.h"
+#include "LayoutText.h"
+#include "RailmlImport.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+static double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void BuildDemo(TrackNetwork *network, float endX, float switchX) {
+  // As updateLayout in main.cpp
+  const float divergentRise = 5.0f;
+  ImVec2 bend = ImVec2(switchX + divergentRise, -divergentRise);
+  network->AddSegment(ImVec2(0, 0), ImVec2(switchX, 0));
+  network->AddSegment(ImVec2(switchX, 0), ImVec2(endX, 0));
+  network->AddSegment(ImVec2(switchX, 0), bend);
+  network->AddSegment(bend, ImVec2(endX, -divergentRise));
+  network->Connect(2, 3);
+  network->AddSwitch(0, 1, 2);
+}
+
+static void BuildYard(TrackNetwork *network, int sidings, int sidingLength) {
+  // The main line runs along y = 0 with a switch at the end of every
+  // segment; siding k leaves switch k and runs parallel at y = -(k + 1)
+  const float segmentLength = 20.0f;
+  for (int k = 0; k <= sidings; k++) {
+    network->AddSegment(ImVec2(k * segmentLength, 0),
+                        ImVec2((k + 1) * segmentLength, 0));
+  }
+  for (int k = 0; k < sidings; k++) {
+    ImVec2 start = ImVec2((k + 1) * segmentLength, 0);
+    float y = -(k + 1.0f);
+    int previous = network->AddSegment(start, ImVec2(start.x + 5.0f, y));
+    int first = previous;
+    for (int i = 1; i < sidingLength; i++) {
+      float x = start.x + 5.0f + (i - 1) * segmentLength;
+      int segment = network->AddSegment(ImVec2(x, y),
+                                        ImVec2(x + segmentLength, y));
+      network->Connect(previous, segment);
+      previous = segment;
+    }
+    network->AddSwitch(k, k + 1, first);
+    network->AddSignal(first, 1.0f);
+  }
+}
+
+static double FileMegabytes(const char *path) {
+  struct stat status;
+  return stat(path, &status) == 0 ? status.st_size / 1e6 : 0.0;
+}
+
+static double PeakMegabytes() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1e3; // Kilobytes on Linux
+}
+
+static bool EndsWith(const char *text, const char *suffix) {
+  size_t length = strlen(text);
+  size_t suffixLength = strlen(suffix);
+  return length >= suffixLength &&
+         strcmp(text + length - suffixLength, suffix) == 0;
+}
+
+int main(int argc, char **argv) {
+  const char *mode = argc == 5 || argc == 4 ? argv[1] : "";
+  bool built = argc == 5 && (strcmp(mode, "demo") == 0 ||
+                             strcmp(mode, "yard") == 0);
+  bool imported = argc == 4 && (strcmp(mode, "text") == 0 ||
+                                strcmp(mode, "railml") == 0);
+  if (!built && !imported) {
+    fprintf(stderr,
+            "usage: %s demo <track length> <switch position> <out>\n"
+            "       %s yard <sidings> <segments per siding> <out>\n"
+            "       %s text <in> <out>\n"
+            "       %s railml <in> <out>\n",
+            argv[0], argv[0], argv[0], argv[0]);
+    return 1;
+  }
+  const char *path = argv[argc - 1];
+
+  TrackNetwork network;
+  if (strcmp(mode, "demo") == 0) {
+    BuildDemo(&network, (float)atof(argv[2]), (float)atof(argv[3]));
+  } else if (strcmp(mode, "yard") == 0) {
+    int sidings = atoi(argv[2]);
+    int sidingLength = atoi(argv[3]);
+    if (sidings < 0 || sidingLength < 1) {
+      fprintf(stderr, "%s: bad yard size\n", argv[0]);
+      return 1;
+    }
+    BuildYard(&network, sidings, sidingLength);
+  } else if (strcmp(mode, "railml") == 0) {
+    RailmlError error;
+    Clock::time_point start = Clock::now();
+    if (!ImportRailml(argv[2], &network, &error)) {
+      fprintf(stderr, "%s:%lld: %s\n", argv[2], error.line, error.message);
+      return 1;
+    }
+    double seconds = SecondsSince(start);
+    double megabytes = FileMegabytes(argv[2]);
+    printf("%s: %.1f MB imported in %.3f s, %.1f MB/s, peak memory %.1f MB\n",
+           argv[2], megabytes, seconds, megabytes / seconds, PeakMegabytes());
+  } else {
+    int workerCount = (int)std::thread::hardware_concurrency() - 1;
+    JobSystem jobs(workerCount > 0 ? workerCount : 0);
+    LayoutTextError error;
+    Clock::time_point start = Clock::now();
+    if (!ImportLayoutText(argv[2], &network, &jobs, &error)) {
+      fprintf(stderr, "%s:%lld: %s\n", argv[2], error.line, error.message);
+      return 1;
+    }
+    double seconds = SecondsSince(start);
+    double megabytes = FileMegabytes(argv[2]);
+    printf("%s: %.1f MB imported in %.3f s on %d threads, %.1f MB/s\n",
+           argv[2], megabytes, seconds, jobs.ThreadCount(),
+           megabytes / seconds);
+  }
+
+  if (EndsWith(path, ".txt")) {
+    if (!ExportLayoutText(path, network)) {
+      fprintf(stderr, "%s: cannot write %s\n", argv[0], path);
+      return 1;
+    }
+    printf("%s: %d segments, %d switches, %d signals\n", path,
+           network.SegmentCount(), network.SwitchCount(),
+           network.SignalCount());
+    return 0;
+  }
+  if (!SaveLayout(path, network)) {
+    fprintf(stderr, "%s: cannot write %s\n", argv[0], path);
+    return 1;
+  }
+
+  TrackNetwork loaded;
+  Clock::time_point start = Clock::now();
+  bool ok = LoadLayout(path, &loaded);
+  double seconds = SecondsSince(start);
+  if (!ok || loaded.SegmentCount() != network.SegmentCount() ||
+      loaded.SwitchCount() != network.SwitchCount()) {
+    fprintf(stderr, "%s: %s does not load back\n", argv[0], path);
+    return 1;
+  }
+  printf("%s: %d segments, %d switches, %d signals, loaded in %.3f ms\n",
+         path, loaded.SegmentCount(), loaded.SwitchCount(),
+         loaded.SignalCount(), seconds * 1e3);
+  return 0;
+}
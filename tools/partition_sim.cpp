@@ -0,0 +1,175 @@
+// Runs a line of trains split across several processes on this host and
+// compares where they end up with the same trains stepped in one process,
+// failing on any difference.
+//
+//   partition_sim [partitions] [trains] [ticks]
+#include "RegionSimulation.h"
+#include "SimulationPartition.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const int segmentCount = 4000;
+static const float segmentLength = 20.0f;
+static const float dt = 1.0f / 60.0f;
+
+struct TrainResult {
+  int id;
+  float x;
+  float y;
+};
+
+static void BuildNetwork(TrackNetwork *network) {
+  for (int i = 0; i < segmentCount; i++) {
+    network->AddSegment(ImVec2(i * segmentLength, 0),
+                        ImVec2((i + 1) * segmentLength, 0));
+    if (i > 0) {
+      network->Connect(i - 1, i);
+    }
+  }
+}
+
+static std::vector<StockTables> BuildStock() {
+  RollingStock stock;
+  stock.mass = 40000;
+  stock.maxSpeed = 25;
+  stock.tractiveEffort = {{0, 40000}, {25, 8000}};
+  stock.brakingForce = {{0, 48000}};
+  stock.resistanceA = 600;
+  stock.resistanceB = 10;
+  stock.resistanceC = 1.5f;
+  return std::vector<StockTables>(1, BuildStockTables(stock));
+}
+
+// Spreads the trains evenly along the line, varying length and line speed
+static void TrainAt(int id, int trainCount, int *segment, float *length,
+                    float *lineSpeed) {
+  *segment = id * (segmentCount - 10) / trainCount + 2;
+  *length = 30.0f + (id % 3) * 10.0f;
+  *lineSpeed = 10.0f + (id % 5);
+}
+
+static int RunPartition(const TrackNetwork &network,
+                        const std::vector<int> &segmentRegion, int self,
+                        const char *directory, int trainCount, int ticks,
+                        int output) {
+  SimulationPartition partition(network, segmentRegion, self, BuildStock(),
+                                dt);
+  for (int id = 0; id < trainCount; id++) {
+    int segment;
+    float length, lineSpeed;
+    TrainAt(id, trainCount, &segment, &length, &lineSpeed);
+    partition.AddTrain(id, segment, 5.0f, length, 0, lineSpeed);
+  }
+  if (!partition.Connect(directory) || !partition.Run(ticks) ||
+      !partition.Finish()) {
+    fprintf(stderr, "partition %d: link failed at tick %d\n", self,
+            partition.Tick());
+    return 1;
+  }
+  printf("partition %d: %d trains, %d handoffs, %d null messages, %d of %d "
+         "ticks waited\n",
+         self, partition.Local().fleet.Count(), partition.handoffsSent,
+         partition.nullMessagesSent, partition.waits, ticks);
+  fflush(stdout);
+
+  const TrainFleet &fleet = partition.Local().fleet;
+  for (int i = 0; i < fleet.Count(); i++) {
+    TrainResult result = {partition.TrainId(i), fleet.x[i], fleet.y[i]};
+    if (write(output, &result, sizeof(result)) != sizeof(result)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int partitionCount = argc > 1 ? atoi(argv[1]) : 4;
+  int trainCount = argc > 2 ? atoi(argv[2]) : 800;
+  int ticks = argc > 3 ? atoi(argv[3]) : 3000;
+  if (partitionCount < 1 || trainCount < 1 || ticks < 0) {
+    fprintf(stderr, "usage: %s [partitions] [trains] [ticks]\n", argv[0]);
+    return 1;
+  }
+
+  TrackNetwork network;
+  BuildNetwork(&network);
+  std::vector<int> segmentRegion = PartitionSegments(network, partitionCount);
+
+  char directory[] = "/tmp/partition_sim.XXXXXX";
+  if (!mkdtemp(directory)) {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  // Each partition sends its trains back over its own pipe
+  std::vector<pid_t> children;
+  std::vector<int> outputs;
+  for (int self = 0; self < partitionCount; self++) {
+    int fds[2];
+    if (pipe(fds)) {
+      perror("pipe");
+      return 1;
+    }
+    pid_t child = fork();
+    if (child == 0) {
+      close(fds[0]);
+      _exit(RunPartition(network, segmentRegion, self, directory, trainCount,
+                         ticks, fds[1]));
+    }
+    close(fds[1]);
+    children.push_back(child);
+    outputs.push_back(fds[0]);
+  }
+
+  std::vector<TrainResult> results(trainCount);
+  std::vector<unsigned char> found(trainCount, 0);
+  for (int output : outputs) {
+    TrainResult result;
+    while (read(output, &result, sizeof(result)) == sizeof(result)) {
+      if (result.id >= 0 && result.id < trainCount) {
+        results[result.id] = result;
+        found[result.id] = 1;
+      }
+    }
+    close(output);
+  }
+  bool failed = false;
+  for (pid_t child : children) {
+    int status = 0;
+    waitpid(child, &status, 0);
+    failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+  rmdir(directory);
+
+  // The same trains in one process
+  Simulation single;
+  single.stock = BuildStock();
+  single.Reset(network);
+  for (int id = 0; id < trainCount; id++) {
+    int segment;
+    float length, lineSpeed;
+    TrainAt(id, trainCount, &segment, &length, &lineSpeed);
+    single.AddTrain(network, segment, 5.0f, length, 0, lineSpeed);
+  }
+  for (int tick = 0; tick < ticks; tick++) {
+    single.Step(network, nullptr, nullptr, nullptr, dt, nullptr);
+  }
+
+  int missing = 0;
+  float largest = 0.0f;
+  for (int id = 0; id < trainCount; id++) {
+    if (!found[id]) {
+      missing++;
+      continue;
+    }
+    largest = std::max(largest, fabsf(results[id].x - single.fleet.x[id]));
+    largest = std::max(largest, fabsf(results[id].y - single.fleet.y[id]));
+  }
+  printf("%d trains missing, largest difference from one process %g\n",
+         missing, largest);
+  // The partitions' protocol promises the sequential result exactly
+  return failed || missing || largest != 0.0f ? 1 : 0;
+}
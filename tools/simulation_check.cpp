@@ -0,0 +1,312 @@
+// Checks properties of the simulation and its importers that a change
+// could quietly break, printing each and exiting with status 1 if any
+// fails.
+//
+//   simulation_check
+#include "KineticHeadway.h"
+#include "MovementAuthority.h"
+#include "RailmlImport.h"
+#include "Simulation.h"
+#include <atomic>
+#include <math.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+// Every allocation through operator new, from any thread; operator new[]
+// and the nothrow forms come through here too
+static std::atomic<long long> allocations(0);
+
+// Neither is inlined, or GCC pairs malloc() and free() with new and delete
+// and warns of a mismatch
+__attribute__((noinline)) void *operator new(size_t size) {
+  allocations++;
+  void *memory = malloc(size ? size : 1);
+  if (!memory) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+__attribute__((noinline)) void operator delete(void *memory) noexcept {
+  free(memory);
+}
+
+static void Check(bool passed, const char *what) {
+  printf("%s: %s\n", passed ? "ok" : "FAILED", what);
+  failures += passed ? 0 : 1;
+}
+
+static std::vector<StockTables> BuildStock() {
+  RollingStock stock;
+  stock.mass = 40000;
+  stock.maxSpeed = 25;
+  stock.tractiveEffort = {{0, 40000}, {25, 8000}};
+  stock.brakingForce = {{0, 48000}};
+  stock.resistanceA = 600;
+  stock.resistanceB = 10;
+  stock.resistanceC = 1.5f;
+  return std::vector<StockTables>(1, BuildStockTables(stock));
+}
+
+static void BuildLine(TrackNetwork *network, int segmentCount,
+                      float segmentLength) {
+  for (int i = 0; i < segmentCount; i++) {
+    network->AddSegment(ImVec2(i * segmentLength, 0),
+                        ImVec2((i + 1) * segmentLength, 0));
+    if (i > 0) {
+      network->Connect(i - 1, i);
+    }
+  }
+}
+
+// Movement authority is cached per segment and shared by the trains behind
+// it, so each train's authority must come out the same whichever trains
+// filled the cache first
+static bool IsAuthorityOrderFree(const TrackNetwork &network,
+                                 int occupiedSegment,
+                                 const std::vector<int> &trainSegments) {
+  std::vector<StockTables> stock = BuildStock();
+  BitSet occupied;
+  occupied.Resize(network.SegmentCount());
+  occupied.Set(occupiedSegment);
+  Arena arena;
+
+  TrainFleet fleet;
+  std::vector<PackedTrain> packed;
+  for (int segment : trainSegments) {
+    fleet.Add(segment, 10.0f);
+    PackedTrain train = {};
+    packed.push_back(train);
+  }
+  MovementAuthority together;
+  together.Compute(network, occupied, nullptr, nullptr, fleet, packed.data(),
+                   stock, &arena);
+
+  bool isSame = true;
+  for (int i = 0; i < fleet.Count(); i++) {
+    TrainFleet alone;
+    alone.Add(fleet.segment[i], fleet.offset[i]);
+    MovementAuthority authority;
+    arena.Reset();
+    authority.Compute(network, occupied, nullptr, nullptr, alone,
+                      packed.data(), stock, &arena);
+    if (fabsf(authority.distance[0] - together.distance[i]) > 1e-3f ||
+        fabsf(authority.speedLimit[0] - together.speedLimit[i]) > 1e-3f) {
+      printf("  train on segment %d: %.1f at %.1f alone, %.1f at %.1f in "
+             "the fleet\n",
+             fleet.segment[i], authority.distance[0],
+             authority.speedLimit[0], together.distance[i],
+             together.speedLimit[i]);
+      isSame = false;
+    }
+  }
+  return isSame;
+}
+
+static void CheckMovementAuthority() {
+  // A train behind walks past the cap before the obstruction ahead of one
+  // in front
+  TrackNetwork shortLine;
+  BuildLine(&shortLine, 7, 300.0f);
+  Check(IsAuthorityOrderFree(shortLine, 5, {0, 3}),
+        "authority ahead of a capped walk");
+
+  // A train on every segment of a line longer than the cap
+  TrackNetwork longLine;
+  BuildLine(&longLine, 60, 100.0f);
+  std::vector<int> everySegment;
+  for (int i = 0; i < 55; i++) {
+    everySegment.push_back(i);
+  }
+  Check(IsAuthorityOrderFree(longLine, 55, everySegment),
+        "authority with a train on every segment");
+}
+
+// A fleet on a loop keeps moving, so once every segment has seen its
+// busiest tick a Step should take everything it needs from its arenas
+static void CheckSteadyStateAllocations() {
+  const int trainCount = 5000;
+  const int warmUpTicks = 600;
+  const int ticks = 3000;
+  const float dt = 1.0f / 60.0f;
+  TrackNetwork network;
+  int segmentCount = 2 * trainCount;
+  BuildLine(&network, segmentCount, 20.0f);
+  network.Connect(segmentCount - 1, 0);
+  Simulation simulation;
+  simulation.stock = BuildStock();
+  simulation.Reset(network);
+  for (int i = 0; i < trainCount; i++) {
+    simulation.AddTrain(network, 2 * i + 1, 15.0f, 10.0f, 0,
+                        10.0f + i % 5);
+  }
+  JobSystem jobs(3);
+  for (int tick = 0; tick < warmUpTicks; tick++) {
+    simulation.Step(network, nullptr, nullptr, nullptr, dt, &jobs);
+  }
+  long long before = allocations;
+  for (int tick = 0; tick < ticks; tick++) {
+    simulation.Step(network, nullptr, nullptr, nullptr, dt, &jobs);
+  }
+  long long made = allocations - before;
+  if (made > 0) {
+    printf("  %lld allocations in %d ticks\n", made, ticks);
+  }
+  Check(made == 0, "no allocations in a steady-state Step");
+}
+
+// The tail runs the distance the head does each tick, so however long a
+// train runs its length should not creep
+static void CheckTrainLength() {
+  const float segmentLength = 20.0f;
+  const float length = 4.0f;
+  const int ticks = 36000;
+  const float dt = 1.0f / 60.0f;
+  TrackNetwork network;
+  BuildLine(&network, 200, segmentLength);
+  Simulation simulation;
+  simulation.stock = BuildStock();
+  simulation.Reset(network);
+  simulation.AddTrain(network, 1, 10.0f, length, 0, 2.0f);
+  for (int tick = 0; tick < ticks; tick++) {
+    simulation.Step(network, nullptr, nullptr, nullptr, dt, nullptr);
+  }
+  const TrainFleet &fleet = simulation.fleet;
+  float head = fleet.segment[0] * segmentLength + fleet.offset[0];
+  float tail = simulation.packed[0].tailSegment * segmentLength +
+               fleet.tailOffset[0];
+  if (fabsf(head - tail - length) > 1e-2f) {
+    printf("  %.4f units long after %.0f units\n", head - tail,
+           head - 10.0f - segmentLength);
+  }
+  Check(fabsf(head - tail - length) <= 1e-2f,
+        "train length kept over a long run");
+}
+
+// A train closing on one whose tail is already on the next segment must be
+// warned of as well as one closing on the same segment
+// The vector dynamics must give the scalar loop's speeds to the bit, over
+// several stocks, speeds past the end of the tables and a ragged last group
+static void CheckDynamicsPaths() {
+  std::vector<StockTables> stock = BuildStock();
+  for (int i = 1; i < 3; i++) {
+    stock.push_back(stock[0]);
+    for (int sample = 0; sample < StockTables::sampleCount; sample++) {
+      stock[i].traction[sample] *= 0.5f * i;
+      stock[i].braking[sample] *= 1.0f + i;
+    }
+  }
+  TrainFleet vector;
+  std::vector<PackedTrain> packed;
+  srand(7);
+  for (int i = 0; i < 1003; i++) {
+    vector.Add(0, 0.0f);
+    vector.speed[i] = 40.0f * rand() / RAND_MAX;
+    vector.targetSpeed[i] = i % 5 == 0 ? 0.0f : 30.0f * rand() / RAND_MAX;
+    PackedTrain train = {};
+    train.stock = (uint16_t)(rand() % 3);
+    packed.push_back(train);
+  }
+  TrainFleet scalar = vector;
+  bool same = true;
+  for (int tick = 0; tick < 120; tick++) {
+    StepDynamics(&vector, packed.data(), stock, 1.0f / 60.0f);
+    StepDynamicsScalar(&scalar, packed.data(), stock, 1.0f / 60.0f, 0,
+                       scalar.Count());
+    for (int i = 0; i < scalar.Count(); i++) {
+      same = same && vector.speed[i] == scalar.speed[i] &&
+             vector.acceleration[i] == scalar.acceleration[i];
+    }
+  }
+  Check(same, "vector dynamics match the scalar loop");
+}
+
+static void CheckKineticHeadway() {
+  TrackNetwork network;
+  BuildLine(&network, 5, 20.0f);
+  Simulation simulation;
+  simulation.stock = BuildStock();
+  simulation.Reset(network);
+  int rear = simulation.AddTrain(network, 0, 18.0f, 4.0f, 0, 10.0f);
+  int front = simulation.AddTrain(network, 1, 6.0f, 4.0f, 0, 10.0f);
+
+  HeadwayMonitor monitor;
+  monitor.Resize(network.SegmentCount());
+  std::vector<HeadwayConflict> conflicts;
+  for (int train = 0; train < simulation.fleet.Count(); train++) {
+    monitor.UpdateTrain(network, simulation.occupancy, train, train,
+                        simulation.fleet.tailOffset[train],
+                        simulation.fleet.offset[train]);
+  }
+  monitor.Detect(network, &conflicts);
+
+  // 4 units apart and closing at 5 units a second: headway goes in 0.4 s
+  KineticHeadway kinetic;
+  EventQueue events;
+  kinetic.SetMotion(rear, 10.0f, 0.0f);
+  kinetic.SetMotion(front, 5.0f, 0.0f);
+  kinetic.Refresh(network, monitor, 0.0, &events);
+  std::vector<ConflictWarning> warnings;
+  SimEvent event;
+  while (events.PopDue(0.0, &event)) {
+    kinetic.HandleEvent(event, &warnings);
+  }
+  Check(conflicts.empty() && warnings.size() == 1 &&
+            warnings[0].rearTrain == rear && warnings[0].frontTrain == front &&
+            fabs(warnings[0].conflictTime - 0.4) < 1e-3,
+        "conflict predicted across a segment end");
+}
+
+// Imports `text` as a railML file, true if it was accepted
+static bool ImportsRailml(const char *text) {
+  char path[] = "/tmp/simulation_check.XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return false;
+  }
+  FILE *file = fdopen(fd, "w");
+  fputs(text, file);
+  fclose(file);
+  TrackNetwork network;
+  RailmlError error;
+  bool imported = ImportRailml(path, &network, &error);
+  unlink(path);
+  return imported;
+}
+
+static void CheckRailml() {
+  Check(ImportsRailml("<railml><infrastructure><tracks>\n"
+                      "<track id=\"a\"><trackTopology>\n"
+                      "<trackBegin pos=\"0\"><geoCoord coord=\"0 0\"/>"
+                      "</trackBegin>\n"
+                      "<trackEnd pos=\"100\"><geoCoord coord=\"100 0\"/>"
+                      "</trackEnd>\n"
+                      "</trackTopology></track>\n"
+                      "</tracks></infrastructure></railml>\n"),
+        "railML track placed at both ends");
+
+  // Both ends within samePosition of the one geoCoord
+  Check(!ImportsRailml("<railml><infrastructure><tracks>\n"
+                       "<track id=\"a\"><trackTopology>\n"
+                       "<trackBegin pos=\"0\"><geoCoord coord=\"0 0\"/>"
+                       "</trackBegin>\n"
+                       "<trackEnd pos=\"0\"/>\n"
+                       "</trackTopology></track>\n"
+                       "</tracks></infrastructure></railml>\n"),
+        "railML track placed by one geoCoord refused");
+}
+
+int main() {
+  CheckMovementAuthority();
+  CheckRailml();
+  CheckSteadyStateAllocations();
+  CheckTrainLength();
+  CheckDynamicsPaths();
+  CheckKineticHeadway();
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+// Runs a timetable on a layout without drawing it, for checking feeds and
+// timing large ones.
+//
+//   timetable_run <layout> <feed directory> <YYYYMMDD> [hours] [tick]
+//
+// The layout is a text layout if it ends in .txt and a binary one
+// otherwise. The clock starts at midnight on the given date and runs for
+// `hours`, 24 by default, in ticks of `tick` seconds, 1 by default.
+#include "LayoutFile.h"
+#include "LayoutText.h"
+#include "TimetableService.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+static double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static std::vector<StockTables> BuildStock() {
+  RollingStock stock;
+  stock.mass = 40000;
+  stock.maxSpeed = 25;
+  stock.tractiveEffort = {{0, 40000}, {25, 8000}};
+  stock.brakingForce = {{0, 48000}};
+  stock.resistanceA = 600;
+  stock.resistanceB = 10;
+  stock.resistanceC = 1.5f;
+  return std::vector<StockTables>(1, BuildStockTables(stock));
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4 || argc > 6) {
+    fprintf(stderr,
+            "usage: %s <layout> <feed directory> <YYYYMMDD> [hours] [tick]\n",
+            argv[0]);
+    return 1;
+  }
+  int date = atoi(argv[3]);
+  double hours = argc > 4 ? atof(argv[4]) : 24.0;
+  float tick = argc > 5 ? (float)atof(argv[5]) : 1.0f;
+  if (date < 10000101 || hours <= 0 || tick <= 0) {
+    fprintf(stderr, "%s: bad date, hours or tick\n", argv[0]);
+    return 1;
+  }
+
+  int workerCount = (int)std::thread::hardware_concurrency() - 1;
+  JobSystem jobs(workerCount > 0 ? workerCount : 0);
+  TrackNetwork network;
+  size_t pathLength = strlen(argv[1]);
+  if (pathLength > 4 && strcmp(argv[1] + pathLength - 4, ".txt") == 0) {
+    LayoutTextError error;
+    if (!ImportLayoutText(argv[1], &network, &jobs, &error)) {
+      fprintf(stderr, "%s:%lld: %s\n", argv[1], error.line, error.message);
+      return 1;
+    }
+  } else if (!LoadLayout(argv[1], &network)) {
+    fprintf(stderr, "%s: cannot load %s\n", argv[0], argv[1]);
+    return 1;
+  }
+
+  Timetable timetable;
+  TimetableError error;
+  Clock::time_point start = Clock::now();
+  if (!LoadTimetable(argv[2], network, &timetable, &error)) {
+    fprintf(stderr, "%s/%s:%lld: %s\n", argv[2], error.file, error.line,
+            error.message);
+    return 1;
+  }
+  printf("%s: %d trips loaded in %.3f s, last departure %02d:%02d\n", argv[2],
+         timetable.TripCount(), SecondsSince(start),
+         timetable.LastDeparture() / 3600, timetable.LastDeparture() / 60 % 60);
+
+  Simulation simulation;
+  simulation.stock = BuildStock();
+  simulation.Reset(network);
+  TimetableService service;
+  service.Start(DayNumber(date / 10000, date / 100 % 100, date % 100), 0.0);
+  int ticks = (int)(hours * 3600 / tick);
+  int mostTrains = 0;
+  start = Clock::now();
+  for (int i = 0; i < ticks; i++) {
+    service.Advance(timetable, network, &simulation, tick);
+    simulation.Step(network, nullptr, nullptr, nullptr, tick, &jobs);
+    mostTrains = std::max(mostTrains, simulation.fleet.Count());
+  }
+  double seconds = SecondsSince(start);
+  printf("%d ticks in %.3f s: %d departed, %d held, %d finished, %d "
+         "running, at most %d at once, %d waiting\n",
+         ticks, seconds, service.departed, service.held, service.finished,
+         simulation.fleet.Count(), mostTrains, (int)service.waiting.size());
+  return 0;
+}